@@ -7,8 +7,44 @@
  * HFUSE = 0xde
  * LFUSE = 0xe2
  * 
+ * FREQUENCY METER
+ * --------
+ * PB0 is also ICP1, Timer1 runs at F_CPU (8 MHz internal RC, 125 ns) and
+ * timestamps every rising edge in hardware, with the noise canceler on.
+ * The overflows extend the timestamps to 32 bits (20 ms = 160000 ticks).
+ * Each period goes through a running filter (weight 1/8): mean period and
+ * mean absolute deviation of the period (edge jitter).
+ * Every PUBLISH_CYCLES periods one frame goes out on the UART (TXD, PD1),
+ * 38400 8N1, with the same framing as the USB stream of the STM32:
+ *   0xA5 0x5A <type 0x01> <length 11> <payload> <CRC16 Modbus, of type..payload>
+ * payload, little endian:
+ *   uint32 period in ns, uint16 frequency in mHz, uint16 jitter in ns,
+ *   uint8 sequence, uint8 glitches (saturates at 255),
+ *   uint8 flags (bit 0: frequency locked, bit 1: PLL output locked)
+ * The RC oscillator is only 1% after calibration, CLOCK_PPM corrects it
+ * (measure a known 50.000 Hz and put the error here).
+ * 
+ * PLL OUTPUT (ZC_OUTPUT_PLL 1)
+ * --------
+ * PC5 is not copied from the input any more. A software PLL follows the
+ * captured rising edges and predicts the next one; the Timer1 compare A
+ * interrupt comes OUTPUT_LEAD ticks before it and waits on TCNT1 for the exact
+ * tick, so the other interrupts only eat into the lead, not into the edge.
+ * PC5 goes high at the predicted capture time of the input edge (+ OUTPUT_OFFSET)
+ * and low half a period later, within about 1 us, with the fixed delay of the
+ * capture (comparator + 4 ticks noise canceler) instead of the PCINT latency.
+ *   - proportional 1/4 and integral 1/64 of the edge error, per period
+ *   - edges further than 1/8 period from the prediction are glitches
+ *   - PC5 only pulses after PLL_LOCK_CYCLES edges within PLL_LOCK_WINDOW, one
+ *     edge outside the window stops the pulses until it locks again
+ *   - PLL_COAST periods without an edge keep the pulses, then PC5 stays low
+ *     until it locks again
+ * Timer0 (millis) is stopped, its interrupt would be one more source of delay.
+ * ZC_OUTPUT_PLL 0 gives back the old pin change copy of the input.
  */
 
+#define ZC_OUTPUT_PLL       1
+
 #define PCINT_PIN 8         // PB0 - PCINT0
 #define PCINT_MODE CHANGE
 #define PCINT_FUNCTION      getZeroCross
@@ -40,8 +76,60 @@ volatile uint8_t oldPort = 0x00;
 #define LEDOFF              PORTB &= ~(1<<PB5)
 #define LEDTOGGLE           PORTB ^= (1<<PB5)
 
+#define CLOCK_PPM           0L                  // Error of the RC oscillator, + if it runs fast
+#define CLOCK_HZ            (F_CPU + (F_CPU / 1000000L) * CLOCK_PPM)
+#define PERIOD_MIN          (CLOCK_HZ / 65)     // Ticks, shorter is a glitch
+#define PERIOD_MAX          (CLOCK_HZ / 45)     // Ticks, longer is a lost edge
+#define FILTER_SHIFT        3                   // Running filter weight 1/8
+#define LOCK_PERIODS        16                  // Good periods in a row before locked
+#define PUBLISH_CYCLES      10                  // 5 frames per second at 50 Hz
+#define UART_BAUD           38400
+
+#define OUTPUT_LEAD         320                 // Ticks (40 us) the compare comes before the edge
+#define OUTPUT_OFFSET       0                   // Ticks from the predicted edge to the output
+#define PLL_KP_SHIFT        2                   // Proportional gain 1/4
+#define PLL_KI_SHIFT        6                   // Integral gain 1/64
+#define PLL_LOCK_WINDOW     400                 // Ticks (50 us)
+#define PLL_LOCK_CYCLES     25
+#define PLL_COAST           5                   // Periods without an edge before unlock
+
+#define PLL_IDLE            0
+#define PLL_LOCKING         1
+#define PLL_LOCKED          2
+
+#define FRAME_SYNC0         0xA5
+#define FRAME_SYNC1         0x5A
+#define FRAME_FREQUENCY     0x01
+
 volatile uint8_t pulse_counter = 0;
 
+// Timer1 input capture, written by the interrupts
+volatile uint16_t timer_overflows = 0;  // High word of the time
+volatile uint32_t last_edge = 0;        // Time of the last rising edge, ticks
+volatile uint32_t edge_period = 0;      // Last period, ticks
+volatile uint8_t edge_count = 0;        // + 1 on every new period
+volatile uint8_t edge_started = 0;      // last_edge is valid
+volatile uint8_t glitches = 0;
+
+// Software PLL, in the Timer1 interrupts
+volatile uint8_t pll_state = PLL_IDLE;
+volatile uint32_t pll_edge;        // Predicted rising edge, ticks
+volatile uint32_t pll_period;      // Ticks * 256
+volatile uint32_t captured_edge;   // Last edge for the PLL
+volatile uint8_t captured = 0;
+volatile uint8_t pll_good = 0;     // Edges in a row within PLL_LOCK_WINDOW
+volatile uint8_t pll_missed = 0;   // Periods in a row without an edge
+volatile uint32_t output_time;     // Next output edge, ticks
+volatile uint8_t output_rising;    // Next output edge is the rising one
+volatile uint16_t output_late = 0; // The compare came after the edge
+
+// Running filter, only in loop()
+uint32_t period_filtered = 0;  // Ticks * 16
+uint32_t jitter_filtered = 0;  // Ticks * 16
+uint8_t good_periods = 0;
+uint8_t publish_counter = 0;
+uint8_t sequence = 0;
+
 void setup() {
   // led pin as output
   DDRB |= (1<<PB5);
@@ -54,9 +142,103 @@ void setup() {
   PCMSK |= (1 << PCINT);
   // PCICR: Pin Change Interrupt Control Register - enables interrupt vectors
   PCICR |= (1 << PCIE);
+
+  // ==== Timer1: normal mode, no prescaler, capture on the rising edge of ICP1
+  // (the Arduino core set it for PWM)
+  TCCR1A = 0;
+  TCCR1B = (1<<ICNC1) | (1<<ICES1) | (1<<CS10);
+  TCNT1 = 0;
+  TIFR1 = (1<<ICF1) | (1<<TOV1);
+  TIMSK1 = (1<<ICIE1) | (1<<TOIE1);
+
+#if ZC_OUTPUT_PLL
+  PCICR &= ~(1 << PCIE);
+  SIGLOW;
+  TIMSK0 = 0;
+#endif
+
+  Serial.begin(UART_BAUD);
 }
 
 void loop() {
+  static uint8_t last_count = 0;
+  uint32_t period;
+  uint8_t count;
+
+  cli();
+  count = edge_count;
+  period = edge_period;
+  sei();
+  if (count == last_count)
+    return;
+  // Periods missed while sending only make the filter a bit slower
+  last_count = count;
+
+  if (period > PERIOD_MAX) {
+    // An edge was lost, start again
+    good_periods = 0;
+    return;
+  }
+  if (good_periods == 0) {
+    period_filtered = period << 4;
+    jitter_filtered = 0;
+  } else {
+    int32_t error = (int32_t)(period << 4) - (int32_t)period_filtered;
+    period_filtered += error >> FILTER_SHIFT;
+    if (error < 0) error = -error;
+    jitter_filtered += (error - (int32_t)jitter_filtered) >> FILTER_SHIFT;
+  }
+  if (good_periods < LOCK_PERIODS)
+    good_periods++;
+
+  if (++publish_counter >= PUBLISH_CYCLES) {
+    publish_counter = 0;
+    sendFrequency();
+  }
+}
+
+// Modbus CRC16 (poly 0xA001, init 0xFFFF), the same as the STM32 side
+uint16_t crc16(uint16_t crc, const uint8_t *data, uint8_t length) {
+  uint8_t i;
+
+  while (length--) {
+    crc ^= *data++;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  }
+  return crc;
+}
+
+void sendFrequency(void) {
+  uint8_t frame[4 + 11 + 2];
+  uint32_t period_ns = (uint64_t)period_filtered * 1000000000ULL / (CLOCK_HZ * 16ULL);
+  uint32_t frequency_mhz = (uint64_t)CLOCK_HZ * 16000ULL / period_filtered;
+  uint32_t jitter_ns = (uint64_t)jitter_filtered * 1000000000ULL / (CLOCK_HZ * 16ULL);
+  uint16_t crc;
+
+  if (frequency_mhz > 0xFFFF) frequency_mhz = 0xFFFF;
+  if (jitter_ns > 0xFFFF) jitter_ns = 0xFFFF;
+
+  frame[0] = FRAME_SYNC0;
+  frame[1] = FRAME_SYNC1;
+  frame[2] = FRAME_FREQUENCY;
+  frame[3] = 11;
+  frame[4] = period_ns;
+  frame[5] = period_ns >> 8;
+  frame[6] = period_ns >> 16;
+  frame[7] = period_ns >> 24;
+  frame[8] = frequency_mhz;
+  frame[9] = frequency_mhz >> 8;
+  frame[10] = jitter_ns;
+  frame[11] = jitter_ns >> 8;
+  frame[12] = sequence++;
+  frame[13] = glitches;
+  frame[14] = ((good_periods >= LOCK_PERIODS) ? 0x01 : 0x00) | ((pll_state == PLL_LOCKED) ? 0x02 : 0x00);
+  crc = crc16(0xFFFF, &frame[2], 2 + 11);
+  frame[15] = crc;
+  frame[16] = crc >> 8;
+  // 17 bytes are 4.4 ms at 38400, they fit in the TX buffer
+  Serial.write(frame, sizeof(frame));
 }
 
 void getZeroCross(void) {
@@ -76,3 +258,135 @@ void getZeroCross(void) {
 ISR(PCINT_vect) {  
   PCINT_FUNCTION();
 }
+
+// Time in ticks, with interrupts disabled
+uint32_t timerNow(void) {
+  uint16_t low = TCNT1;
+  uint16_t high = timer_overflows;
+
+  if ((TIFR1 & (1<<TOV1)) && low < 0x8000)
+    high++;
+  return ((uint32_t)high << 16) | low;
+}
+
+// The compare fires on every wrap of this low word, it only acts on the right one
+void scheduleOutput(uint32_t time, uint8_t rising) {
+  output_time = time;
+  output_rising = rising;
+  OCR1A = (uint16_t)(time - OUTPUT_LEAD);
+  TIFR1 = (1<<OCF1A);
+  TIMSK1 |= (1<<OCIE1A);
+}
+
+void pllStop(void) {
+  TIMSK1 &= ~(1<<OCIE1A);
+  SIGLOW;
+  pll_state = PLL_IDLE;
+  captured = 0;
+}
+
+// Half a period after the predicted edge: one PLL step, then the next rising edge
+void pllUpdate(void) {
+  int32_t error;
+
+  if (captured) {
+    captured = 0;
+    error = (int32_t)(captured_edge - pll_edge);  // + when the input is late
+    if (error > (int32_t)(pll_period >> 11) || -error > (int32_t)(pll_period >> 11)) {
+      // Further than 1/8 period, not our edge
+      if (glitches < 255) glitches++;
+    } else {
+      pll_missed = 0;
+      pll_period += (error << 8) >> PLL_KI_SHIFT;
+      pll_edge += (pll_period >> 8) + (error >> PLL_KP_SHIFT);
+      if (error < PLL_LOCK_WINDOW && -error < PLL_LOCK_WINDOW) {
+        if (pll_good < PLL_LOCK_CYCLES && ++pll_good == PLL_LOCK_CYCLES)
+          pll_state = PLL_LOCKED;
+      } else {
+        // Out of the lock window: no pulses until PLL_LOCK_CYCLES good edges again
+        pll_good = 0;
+        pll_state = PLL_LOCKING;
+      }
+      scheduleOutput(pll_edge + OUTPUT_OFFSET, 1);
+      return;
+    }
+  }
+  // No edge, coast on the last period
+  if (++pll_missed > PLL_COAST || pll_state != PLL_LOCKED) {
+    pllStop();
+    return;
+  }
+  pll_edge += pll_period >> 8;
+  scheduleOutput(pll_edge + OUTPUT_OFFSET, 1);
+}
+
+ISR(TIMER1_COMPA_vect) {
+  uint32_t now = timerNow();
+  int32_t remaining = (int32_t)(output_time - now);
+  uint16_t target = (uint16_t)output_time;
+
+  if (remaining > 2 * OUTPUT_LEAD)
+    return;  // Not this wrap
+  if (remaining < 0) {
+    if (output_late < 0xFFFF) output_late++;
+  } else {
+    while ((int16_t)(TCNT1 - target) < 0);
+  }
+
+  if (output_rising) {
+    if (pll_state == PLL_LOCKED) {
+      SIGHIGH;
+      if (pulse_counter++ == 50) {
+        pulse_counter = 0;
+        LEDTOGGLE;
+      }
+    }
+    scheduleOutput(output_time + (pll_period >> 9), 0);
+  } else {
+    SIGLOW;
+    pllUpdate();
+  }
+}
+
+ISR(TIMER1_OVF_vect) {
+  timer_overflows++;
+}
+
+ISR(TIMER1_CAPT_vect) {
+  uint16_t low = ICR1;
+  uint16_t high = timer_overflows;
+  uint32_t now, period;
+
+  // The overflow came just before the capture, its interrupt is still waiting
+  if ((TIFR1 & (1<<TOV1)) && low < 0x8000)
+    high++;
+  now = ((uint32_t)high << 16) | low;
+  period = now - last_edge;
+
+  if (edge_started && period < PERIOD_MIN) {
+    // Noise on the edge, keep the last good edge as reference
+    if (glitches < 255) glitches++;
+    return;
+  }
+  last_edge = now;
+  if (edge_started) {
+    edge_period = period;
+    edge_count++;
+#if ZC_OUTPUT_PLL
+    if (pll_state != PLL_IDLE) {
+      captured_edge = now;
+      captured = 1;
+    } else if (period >= PERIOD_MIN && period <= PERIOD_MAX) {
+      // Start from the measured period, the first output edge is one period away
+      pll_period = period << 8;
+      pll_edge = now + period;
+      pll_good = 0;
+      pll_missed = 0;
+      captured = 0;
+      pll_state = PLL_LOCKING;
+      scheduleOutput(pll_edge + OUTPUT_OFFSET, 1);
+    }
+#endif
+  }
+  edge_started = 1;
+}
@@ -0,0 +1,86 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it 
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any 
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original 
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness 
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any 
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Buffered transmit over the USB CDC port.
+ *
+ * The data is copied in a ring buffer and sent in packets by the EP1 IN
+ * callback, so the main loop never waits for the PC unless the buffer is full.
+ *
+ * Binary records (decoded on the PC by decodeUsbStream.py):
+ *     0xA5 0x5A <type> <length> <payload, length bytes> <CRC16 low> <CRC16 high>
+ * The CRC is the Modbus CRC16 of type, length and payload. All payload
+ * fields are little endian (the Cortex-M3 byte order).
+ */
+
+#ifndef __USB_STREAM_H
+#define __USB_STREAM_H
+
+#include <stdint.h>
+
+#define STREAM_BUFFER_SIZE  2048  // Must be a power of 2
+
+#define STREAM_SYNC0        0xA5
+#define STREAM_SYNC1        0x5A
+
+// Record types
+#define STREAM_REC_TEXT     0x01  // ASCII text
+#define STREAM_REC_PHASE    0x02  // stream_phase_t
+#define STREAM_REC_BENCH    0x03  // stream_bench_t
+#define STREAM_REC_WAVE     0x04  // stream_wave_t, samples[count]
+
+#define STREAM_WAVE_MAX_SAMPLES  60
+
+typedef struct {
+    int32_t signal_phase;    // Degrees * 10000
+    int32_t computed_phase;  // Degrees * 10000
+} stream_phase_t;
+
+typedef struct {
+    char     name[12];  // Zero padded
+    uint32_t runs;
+    uint32_t min;       // Cycles
+    uint32_t mean;
+    uint32_t max;
+    uint32_t stack;     // Bytes
+} stream_bench_t;
+
+typedef struct {
+    uint16_t first;     // Index of samples[0] in the waveform
+    uint16_t count;
+    float    samples[STREAM_WAVE_MAX_SAMPLES];
+} stream_wave_t;
+
+// Bytes lost because the USB was not configured
+extern volatile uint32_t USB_Stream_Dropped;
+
+// Queue raw bytes, waits only while the buffer is full
+void USB_Stream_Write(const uint8_t *data, uint16_t length);
+
+// Queue one framed binary record
+void USB_Stream_Record(uint8_t type, const void *payload, uint8_t length);
+
+// Send a waveform as STREAM_REC_WAVE records, stride is the distance between samples
+void USB_Stream_Wave(const float *samples, uint16_t count, uint16_t stride);
+
+// Wait until everything in the buffer was sent
+void USB_Stream_Flush(void);
+
+// Called by EP1_IN_Callback when the last packet was sent
+void USB_Stream_TxComplete(void);
+
+#endif
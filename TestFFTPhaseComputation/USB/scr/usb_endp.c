@@ -33,6 +33,7 @@
 #include "hw_config.h"
 #include "usb_istr.h"
 #include "usb_pwr.h"
+#include "usb_stream.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -59,6 +60,8 @@ uint32_t Receive_length;
 void EP1_IN_Callback (void)
 {
   packet_sent = 1;
+  /* Next packet of the transmit buffer */
+  USB_Stream_TxComplete();
 }
 
 /*******************************************************************************
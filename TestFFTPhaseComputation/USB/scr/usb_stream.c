@@ -0,0 +1,132 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it 
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any 
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original 
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness 
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any 
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include "stm32f10x.h"
+#include "usb_lib.h"
+#include "usb_desc.h"
+#include "usb_pwr.h"
+#include "usb_stream.h"
+
+#define STREAM_MASK         (STREAM_BUFFER_SIZE - 1)
+// Packets shorter than wMaxPacketSize, so each one ends the transfer without a ZLP
+#define STREAM_PACKET_SIZE  (VIRTUAL_COM_PORT_DATA_SIZE - 1)
+
+static uint8_t stream_buffer[STREAM_BUFFER_SIZE];
+static volatile uint32_t stream_head;     // Written only by the main loop
+static volatile uint32_t stream_tail;     // Written only by the USB interrupt
+static volatile uint32_t stream_tx_len;   // Bytes in the packet on EP1, 0 if idle
+
+volatile uint32_t USB_Stream_Dropped = 0;
+
+// Start the next packet if EP1 is idle. Runs in the USB interrupt or with it masked.
+static void stream_start_packet(void) {
+    uint32_t tail = stream_tail;
+    uint32_t length = stream_head - tail;
+    uint32_t to_end = STREAM_BUFFER_SIZE - (tail & STREAM_MASK);
+
+    if (stream_tx_len != 0 || length == 0)
+        return;
+    if (length > to_end)
+        length = to_end;
+    if (length > STREAM_PACKET_SIZE)
+        length = STREAM_PACKET_SIZE;
+
+    stream_tx_len = length;
+    UserToPMABufferCopy(&stream_buffer[tail & STREAM_MASK], ENDP1_TXADDR, length);
+    SetEPTxCount(ENDP1, length);
+    SetEPTxValid(ENDP1);
+}
+
+static void stream_kick(void) {
+    NVIC_DisableIRQ(USB_LP_CAN1_RX0_IRQn);
+    stream_start_packet();
+    NVIC_EnableIRQ(USB_LP_CAN1_RX0_IRQn);
+}
+
+void USB_Stream_TxComplete(void) {
+    stream_tail += stream_tx_len;
+    stream_tx_len = 0;
+    stream_start_packet();
+}
+
+void USB_Stream_Write(const uint8_t *data, uint16_t length) {
+    uint32_t head = stream_head;
+
+    while (length--) {
+        // Buffer full, wait for the PC to read
+        while (head - stream_tail >= STREAM_BUFFER_SIZE) {
+            if (bDeviceState != CONFIGURED) {
+                USB_Stream_Dropped += length + 1;
+                return;
+            }
+            stream_head = head;
+            stream_kick();
+        }
+        stream_buffer[head & STREAM_MASK] = *data++;
+        head++;
+    }
+    stream_head = head;
+
+    if (bDeviceState == CONFIGURED)
+        stream_kick();
+}
+
+// Modbus CRC16 (poly 0xA001, init 0xFFFF)
+static uint16_t stream_crc16(uint16_t crc, const uint8_t *data, uint16_t length) {
+    uint8_t i;
+
+    while (length--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+    }
+    return crc;
+}
+
+void USB_Stream_Record(uint8_t type, const void *payload, uint8_t length) {
+    uint8_t header[4] = { STREAM_SYNC0, STREAM_SYNC1, type, length };
+    uint8_t crc[2];
+    uint16_t c;
+
+    c = stream_crc16(0xFFFF, &header[2], 2);
+    c = stream_crc16(c, (const uint8_t *)payload, length);
+    crc[0] = c & 0xFF;
+    crc[1] = c >> 8;
+
+    USB_Stream_Write(header, sizeof(header));
+    USB_Stream_Write((const uint8_t *)payload, length);
+    USB_Stream_Write(crc, sizeof(crc));
+}
+
+void USB_Stream_Wave(const float *samples, uint16_t count, uint16_t stride) {
+    stream_wave_t wave;
+    uint16_t i;
+
+    for (wave.first = 0; wave.first < count; wave.first += wave.count) {
+        wave.count = count - wave.first;
+        if (wave.count > STREAM_WAVE_MAX_SAMPLES)
+            wave.count = STREAM_WAVE_MAX_SAMPLES;
+        for (i = 0; i < wave.count; i++)
+            wave.samples[i] = samples[(uint32_t)(wave.first + i) * stride];
+        USB_Stream_Record(STREAM_REC_WAVE, &wave, 4 + wave.count * sizeof(float));
+    }
+}
+
+void USB_Stream_Flush(void) {
+    while (stream_head != stream_tail && bDeviceState == CONFIGURED)
+        stream_kick();
+}
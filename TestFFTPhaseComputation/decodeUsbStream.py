@@ -0,0 +1,144 @@
+# Decoder of the binary USB stream of TestFFTPhaseComputation (BINARY_STREAM 1).
+#
+# Usage:
+#   python decodeUsbStream.py COM5            read from the serial port (needs pyserial)
+#   python decodeUsbStream.py capture.bin     decode a file saved before
+#   options: --raw FILE    also save the raw bytes
+#            --wave FILE   write the waveforms as CSV (index,value)
+#
+# Record format, see USB/inc/usb_stream.h:
+#   0xA5 0x5A <type> <length> <payload> <CRC16 low> <CRC16 high>
+
+import struct
+import sys
+import os
+
+SYNC = b'\xA5\x5A'
+
+REC_TEXT = 0x01
+REC_PHASE = 0x02
+REC_BENCH = 0x03
+REC_WAVE = 0x04
+
+# Modbus CRC16, the same as stream_crc16() on the STM32
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+class StreamDecoder:
+    def __init__(self):
+        self.buffer = bytearray()
+        self.crc_errors = 0
+        self.skipped = 0
+
+    # Add bytes and return the complete records as (type, payload)
+    def feed(self, data):
+        self.buffer += data
+        records = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                # Keep a last 0xA5, it may be the start of the next record
+                keep = 1 if self.buffer[-1:] == SYNC[:1] else 0
+                self.skipped += len(self.buffer) - keep
+                del self.buffer[:len(self.buffer) - keep]
+                return records
+            self.skipped += start
+            del self.buffer[:start]
+            if len(self.buffer) < 4:
+                return records
+            rec_type, length = self.buffer[2], self.buffer[3]
+            if len(self.buffer) < 6 + length:
+                return records
+            frame = bytes(self.buffer[2:4 + length])
+            crc = self.buffer[4 + length] | (self.buffer[5 + length] << 8)
+            if crc16(frame) != crc:
+                # Not a record, look for the next sync after this one
+                self.crc_errors += 1
+                self.skipped += 1
+                del self.buffer[:1]
+                continue
+            records.append((rec_type, frame[2:]))
+            del self.buffer[:6 + length]
+
+    # End of the input: a header still waiting for its payload was a false sync
+    def finish(self):
+        records = []
+        while len(self.buffer) >= 2:
+            self.skipped += 1
+            del self.buffer[:1]
+            records += self.feed(b'')
+        self.skipped += len(self.buffer)
+        self.buffer.clear()
+        return records
+
+def format_record(rec_type, payload, wave_file):
+    if rec_type == REC_TEXT:
+        return payload.decode('ascii', 'replace')
+    if rec_type == REC_PHASE:
+        sp, p = struct.unpack('<ii', payload)
+        return "PHASE,%.4f,%.4f,%.4f" % (sp / 10000.0, p / 10000.0, (p - sp) / 10000.0)
+    if rec_type == REC_BENCH:
+        name, runs, cmin, cmean, cmax, stack = struct.unpack('<12s5I', payload)
+        return "BENCH,%s,%d,%d,%d,%d,%d" % (name.rstrip(b'\0').decode('ascii'), runs, cmin, cmean, cmax, stack)
+    if rec_type == REC_WAVE:
+        first, count = struct.unpack('<HH', payload[:4])
+        samples = struct.unpack('<%df' % count, payload[4:4 + 4 * count])
+        if wave_file:
+            for i, v in enumerate(samples):
+                wave_file.write("%d,%.7f\n" % (first + i, v))
+        return None
+    return "UNKNOWN,%d,%s" % (rec_type, payload.hex())
+
+def main():
+    args = sys.argv[1:]
+    raw_file = None
+    wave_file = None
+    if '--raw' in args:
+        i = args.index('--raw')
+        raw_file = open(args[i + 1], 'wb')
+        del args[i:i + 2]
+    if '--wave' in args:
+        i = args.index('--wave')
+        wave_file = open(args[i + 1], 'w')
+        del args[i:i + 2]
+    if len(args) != 1:
+        print("Usage: decodeUsbStream.py PORT|FILE [--raw FILE] [--wave FILE]")
+        sys.exit(2)
+
+    if os.path.isfile(args[0]):
+        source = open(args[0], 'rb')
+        read = lambda: source.read(4096)
+    else:
+        import serial
+        source = serial.Serial(args[0], timeout=1)
+        read = lambda: source.read(source.in_waiting or 1)
+
+    decoder = StreamDecoder()
+    try:
+        while True:
+            data = read()
+            if not data:
+                if os.path.isfile(args[0]):
+                    break
+                continue
+            if raw_file:
+                raw_file.write(data)
+            for rec_type, payload in decoder.feed(data):
+                line = format_record(rec_type, payload, wave_file)
+                if line is not None:
+                    print(line)
+    except KeyboardInterrupt:
+        pass
+    for rec_type, payload in decoder.finish():
+        line = format_record(rec_type, payload, wave_file)
+        if line is not None:
+            print(line)
+    if decoder.crc_errors or decoder.skipped:
+        print("CRC errors: %d, skipped bytes: %d" % (decoder.crc_errors, decoder.skipped), file=sys.stderr)
+
+if __name__ == '__main__':
+    main()
@@ -23,11 +23,15 @@
     To compile and run the test, go to:
         https://www.onlinegdb.com/online_c_compiler#
     and copy-paste-run there :)    
+
+    The DSP functions are a copy of dspcore/dsp_core.c (same signatures), so this
+    file stays one single file for the online compiler. Change them there first.
 */
 
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #define PI        3.1415926535897932384626433832795
 #define DEG2RAD   0.01745329251994329576923690768489
@@ -50,7 +54,7 @@ float signal_phase = 0.0;            // Signal phase
 // must be well-isolated. Since the window decreases the leakage, the phase extraction
 // becomes more accurate. However, keep in mind that this window broadens the peaks,
 // so you might sacrifice some resolution in the frequency domain.
-void generate_flat_top_window(float *flattop_window, size_t num_points) {
+void generate_flat_top_window(float *flattop_window, uint16_t num_points) {
     // Flat Top window coefficients
     const float a0 = 1.0;
     const float a1 = 1.93;
@@ -58,7 +62,7 @@ void generate_flat_top_window(float *flattop_window, size_t num_points) {
     const float a3 = 0.388;
     const float a4 = 0.028;
 
-    for (size_t n = 0; n < num_points; n++) {
+    for (uint16_t n = 0; n < num_points; n++) {
         // Compute the normalized index value
         float factor = (2 * PI * n) / (num_points - 1);
 
@@ -80,7 +84,7 @@ void generate_flat_top_window(float *flattop_window, size_t num_points) {
 // Output: Phase at this frequency
 // data is an array of 2*nn elements
 // returns 0 if k >= nn/2
-float myfftPhase (float data[], unsigned long nn, int k) {
+float myfftPhase (float data[], unsigned long nn, uint16_t k) {
     if (k >= nn / 2) {
         return 0.0; // out of range
     }
@@ -236,8 +240,8 @@ void generate_sine_wave(float *signal, size_t num_points, float rms_amplitude, f
 }
 
 // Apply the Flat Top window to the signal
-void apply_flattop_window(float *signal, const float *flattop_window, int num_points) {
-    for (size_t n = 0; n < num_points; n++) {
+void apply_flattop_window(float *signal, const float *flattop_window, uint16_t num_points) {
+    for (uint16_t n = 0; n < num_points; n++) {
         signal[n * 2] = signal[n * 2] * flattop_window[n]; // Apply the window to the real part
     }
 }
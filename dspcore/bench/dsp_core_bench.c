@@ -0,0 +1,327 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Micro-benchmark of every DSP core kernel on the PC.
+
+    Usage: dsp_core_bench [--iterations N] [--json FILE]
+        --iterations   runs of each kernel for each size (default 500)
+        --json         also write the results as JSON to FILE (- for stdout)
+
+    Each kernel runs for N = 256, 512, 1024, 2048 and 4096 samples. For every
+    run we report the mean and minimum ns/op, the CPU cycles/op and the heap
+    allocations/op. The input is restored before each run and is not timed.
+
+    Cycles come from perf_event (real core cycles) when the kernel allows it,
+    else from rdtsc (reference cycles at the TSC frequency), the JSON tells which.
+    Allocations are counted with the linker --wrap=malloc,... option (see
+    CMakeLists.txt), -1 when the build has no wrapper.
+
+    A new kernel variant (Goertzel, fixed point, ...) is one more entry in
+    `kernels[]` below. The numbers are only for comparing two versions on
+    the same PC, the Cortex-M3 without FPU is a lot slower.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "dsp_core.h"
+#include "dsp_dds.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_MAX_POINTS 4096
+
+static const uint16_t sizes[] = { 256, 512, 1024, 2048, 4096 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/* ----------------------- Allocation counter -------------------------------*/
+#ifdef BENCH_COUNT_ALLOCS
+static volatile long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) { allocations++; return __real_malloc(size); }
+void *__wrap_calloc(size_t nmemb, size_t size) { allocations++; return __real_calloc(nmemb, size); }
+void *__wrap_realloc(void *ptr, size_t size) { allocations++; return __real_realloc(ptr, size); }
+#define ALLOCATIONS() (allocations)
+#else
+#define ALLOCATIONS() (-1L)
+#endif
+
+/* ----------------------- Time and cycles ----------------------------------*/
+static int perf_fd = -1;
+static const char *cycle_source = "none";
+
+static void cycles_init(void) {
+#if defined(__linux__)
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+        cycle_source = "perf_event";
+        return;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    cycle_source = "rdtsc";
+#endif
+}
+
+static inline uint64_t cycles_now(void) {
+#if defined(__linux__)
+    if (perf_fd >= 0) {
+        uint64_t count = 0;
+        if (read(perf_fd, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ----------------------- Kernels ------------------------------------------*/
+static int16_t codes[BENCH_MAX_POINTS];           // ADC codes, as read from the SRAM
+static float signal_in[2 * BENCH_MAX_POINTS];     // Converted signal
+static float samples_in[BENCH_MAX_POINTS];        // Converted signal for real_fft_packed()
+static float spectrum_in[2 * BENCH_MAX_POINTS];   // Windowed FFT of the signal
+static float window[BENCH_MAX_POINTS];            // Flat Top window for the current size
+static float data[2 * BENCH_MAX_POINTS];          // Work buffer of the kernel
+static volatile float result;                     // Keeps the compiler from removing the work
+
+// Bin of the 50 Hz fundamental for this size (bin 9 at 2048 samples)
+static uint16_t fundamental_bin(uint16_t n) {
+    uint16_t k = (uint16_t)((uint32_t)DSP_FUNDAMENTAL_BIN * n / DSP_NUM_POINTS);
+    return k ? k : 1;
+}
+
+static void prepare_nothing(uint16_t n) { (void)n; }
+static void prepare_signal(uint16_t n) { memcpy(data, signal_in, 2 * n * sizeof(float)); }
+static void prepare_spectrum(uint16_t n) { memcpy(data, spectrum_in, 2 * n * sizeof(float)); }
+static void prepare_samples(uint16_t n) { memcpy(data, samples_in, n * sizeof(float)); }
+
+static void run_convert(uint16_t n) {
+    convert_adc_codes(codes, data, n);
+}
+
+static void run_window(uint16_t n) {
+    apply_flattop_window(data, window, n);
+}
+
+static void run_fft(uint16_t n) {
+    real_fft(data, n);
+}
+
+static void run_fft_packed(uint16_t n) {
+    real_fft_packed(data, n);
+}
+
+static void run_phase(uint16_t n) {
+    result = myfftPhase(data, n, fundamental_bin(n));
+}
+
+static void run_adjust(uint16_t n) {
+    (void)n;
+    result = adjust_phase(result, 0.5) + adjust_voltage(0.025);
+}
+
+// Test signal of the on-target sweep, fundamental and 3rd / 5th harmonics with noise
+static void run_dds(uint16_t n) {
+    dsp_dds_t dds;
+
+    dsp_dds_init(&dds, 11718.75, 0.002, 1);
+    dsp_dds_add_tone(&dds, 0.025, 50.0, 30.0);
+    dsp_dds_add_harmonic(&dds, 0.025, 50.0, 30.0, 3, 0.10);
+    dsp_dds_add_harmonic(&dds, 0.025, 50.0, 30.0, 5, 0.05);
+    dsp_dds_fill(&dds, data, n);
+}
+
+// What the firmware does for one channel, from ADC codes to the phase
+static void run_pipeline(uint16_t n) {
+    convert_adc_codes(codes, data, n);
+    apply_flattop_window(data, window, n);
+    real_fft(data, n);
+    result = myfftPhase(data, n, fundamental_bin(n));
+}
+
+// The same in half the memory, as treceri/main.c runs it
+static void run_pipeline_packed(uint16_t n) {
+    convert_adc_codes_packed(codes, data, n);
+    apply_flattop_window_packed(data, window, n);
+    real_fft_packed(data, n);
+    result = myfftPhase(data, n, fundamental_bin(n));
+}
+
+typedef struct {
+    const char *name;
+    void (*prepare)(uint16_t n);  // Restore the input, not timed
+    void (*run)(uint16_t n);      // Timed
+} bench_kernel_t;
+
+static const bench_kernel_t kernels[] = {
+    { "convert",         prepare_nothing,  run_convert         },
+    { "window",          prepare_signal,   run_window          },
+    { "real_fft",        prepare_signal,   run_fft             },
+    { "fft_packed",      prepare_samples,  run_fft_packed      },
+    { "phase",           prepare_spectrum, run_phase           },
+    { "adjust",          prepare_nothing,  run_adjust          },
+    { "pipeline",        prepare_nothing,  run_pipeline        },
+    { "pipeline_packed", prepare_nothing,  run_pipeline_packed },
+    { "dds",             prepare_nothing,  run_dds             },
+};
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+typedef struct {
+    double ns_mean;
+    double ns_min;
+    double cycles_mean;
+    double allocs;
+} bench_result_t;
+
+// 25 mV RMS, 50 Hz, 30 degrees at 11718.75 Hz, as ADC codes and volts
+static void prepare_inputs(uint16_t n) {
+    for (uint16_t i = 0; i < n; i++) {
+        double v = 0.025 * sqrt(2.0) * sin(2.0 * PI * 50.0 * i / 11718.75 + 30.0 * DEG2RAD);
+        codes[i] = (int16_t)lrint(v / 2.39 * 3.0 * 32767.0);
+    }
+    convert_adc_codes(codes, signal_in, n);
+    convert_adc_codes_packed(codes, samples_in, n);
+    generate_flat_top_window(window, n);
+    memcpy(spectrum_in, signal_in, 2 * n * sizeof(float));
+    apply_flattop_window(spectrum_in, window, n);
+    real_fft(spectrum_in, n);
+}
+
+static bench_result_t bench_kernel(const bench_kernel_t *kernel, uint16_t n, int iterations) {
+    bench_result_t r = { 0, 1e30, 0, 0 };
+    double t0, t;
+    uint64_t c0;
+    long a0;
+
+    // One warm up run
+    kernel->prepare(n);
+    kernel->run(n);
+
+    for (int it = 0; it < iterations; it++) {
+        kernel->prepare(n);
+        a0 = ALLOCATIONS();
+        c0 = cycles_now();
+        t0 = now_ns();
+        kernel->run(n);
+        t = now_ns() - t0;
+        r.cycles_mean += (double)(cycles_now() - c0);
+        r.allocs += ALLOCATIONS() - a0;
+        r.ns_mean += t;
+        if (t < r.ns_min)
+            r.ns_min = t;
+    }
+    r.ns_mean /= iterations;
+    r.cycles_mean /= iterations;
+    r.allocs = (ALLOCATIONS() < 0) ? -1 : r.allocs / iterations;
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    static bench_result_t results[NUM_KERNELS][NUM_SIZES];
+    int iterations = 500;
+    const char *json_path = NULL;
+    FILE *json;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--iterations N] [--json FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0)
+        iterations = 1;
+
+    cycles_init();
+
+    printf("%-15s %6s %12s %12s %12s %8s\n", "kernel", "N", "ns/op", "min ns", "cycles/op", "allocs");
+    for (size_t s = 0; s < NUM_SIZES; s++) {
+        prepare_inputs(sizes[s]);
+        for (size_t k = 0; k < NUM_KERNELS; k++) {
+            bench_result_t *r = &results[k][s];
+            *r = bench_kernel(&kernels[k], sizes[s], iterations);
+            printf("%-15s %6u %12.1f %12.1f %12.0f %8.2f\n", kernels[k].name, sizes[s],
+                   r->ns_mean, r->ns_min, r->cycles_mean, r->allocs);
+        }
+    }
+    printf("cycles from %s\n", cycle_source);
+
+    if (json_path == NULL)
+        return 0;
+
+    json = strcmp(json_path, "-") ? fopen(json_path, "w") : stdout;
+    if (json == NULL) {
+        perror(json_path);
+        return 1;
+    }
+    fprintf(json, "{\n  \"benchmark\": \"dsp_core\",\n");
+    fprintf(json, "  \"iterations\": %d,\n  \"cycle_source\": \"%s\",\n", iterations, cycle_source);
+    fprintf(json, "  \"results\": [\n");
+    for (size_t k = 0; k < NUM_KERNELS; k++) {
+        for (size_t s = 0; s < NUM_SIZES; s++) {
+            bench_result_t *r = &results[k][s];
+            fprintf(json, "    {\"kernel\": \"%s\", \"n\": %u, \"ns_per_op\": %.1f, \"ns_min\": %.1f, "
+                          "\"cycles_per_op\": %.0f, \"allocs_per_op\": %.2f}%s\n",
+                    kernels[k].name, sizes[s], r->ns_mean, r->ns_min, r->cycles_mean, r->allocs,
+                    (k == NUM_KERNELS - 1 && s == NUM_SIZES - 1) ? "" : ",");
+        }
+    }
+    fprintf(json, "  ]\n}\n");
+    if (json != stdout)
+        fclose(json);
+    return 0;
+}
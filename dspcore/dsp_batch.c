@@ -0,0 +1,249 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "dsp_core.h"
+#include "dsp_batch.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DSP_BATCH_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#define DSP_BATCH_NEON
+#include <arm_neon.h>
+#endif
+
+#define RECORDS_PER_TAKE 16  // Records a thread takes from the queue at once
+
+/* ----------------------- Kernels ------------------------------------------*/
+// ra = sum x * a, rb = sum x * b
+static void dot2_scalar(const float *x, const float *a, const float *b, size_t n, float *ra, float *rb) {
+    float sa[8] = { 0 }, sb[8] = { 0 };
+    size_t i;
+
+    // 8 partial sums, the same order as the AVX2 kernel
+    for (i = 0; i + 8 <= n; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            sa[j] += x[i + j] * a[i + j];
+            sb[j] += x[i + j] * b[i + j];
+        }
+    }
+    for (; i < n; i++) {
+        sa[0] += x[i] * a[i];
+        sb[0] += x[i] * b[i];
+    }
+    *ra = ((sa[0] + sa[4]) + (sa[1] + sa[5])) + ((sa[2] + sa[6]) + (sa[3] + sa[7]));
+    *rb = ((sb[0] + sb[4]) + (sb[1] + sb[5])) + ((sb[2] + sb[6]) + (sb[3] + sb[7]));
+}
+
+#ifdef DSP_BATCH_AVX2
+__attribute__((target("avx2,fma")))
+static float hsum256(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma")))
+static void dot2_avx2(const float *x, const float *a, const float *b, size_t n, float *ra, float *rb) {
+    __m256 sa0 = _mm256_setzero_ps(), sa1 = _mm256_setzero_ps();
+    __m256 sb0 = _mm256_setzero_ps(), sb1 = _mm256_setzero_ps();
+    size_t i;
+
+    // Two accumulators each, to hide the FMA latency
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256 x0 = _mm256_loadu_ps(x + i), x1 = _mm256_loadu_ps(x + i + 8);
+        sa0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(a + i), sa0);
+        sb0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(b + i), sb0);
+        sa1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(a + i + 8), sa1);
+        sb1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(b + i + 8), sb1);
+    }
+    *ra = hsum256(_mm256_add_ps(sa0, sa1));
+    *rb = hsum256(_mm256_add_ps(sb0, sb1));
+    for (; i < n; i++) {
+        *ra += x[i] * a[i];
+        *rb += x[i] * b[i];
+    }
+}
+#endif
+
+#ifdef DSP_BATCH_NEON
+static void dot2_neon(const float *x, const float *a, const float *b, size_t n, float *ra, float *rb) {
+    float32x4_t sa0 = vdupq_n_f32(0), sa1 = vdupq_n_f32(0);
+    float32x4_t sb0 = vdupq_n_f32(0), sb1 = vdupq_n_f32(0);
+    float32x4_t sa, sb;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        float32x4_t x0 = vld1q_f32(x + i), x1 = vld1q_f32(x + i + 4);
+        sa0 = vmlaq_f32(sa0, x0, vld1q_f32(a + i));
+        sb0 = vmlaq_f32(sb0, x0, vld1q_f32(b + i));
+        sa1 = vmlaq_f32(sa1, x1, vld1q_f32(a + i + 4));
+        sb1 = vmlaq_f32(sb1, x1, vld1q_f32(b + i + 4));
+    }
+    sa = vaddq_f32(sa0, sa1);
+    sb = vaddq_f32(sb0, sb1);
+    *ra = vgetq_lane_f32(sa, 0) + vgetq_lane_f32(sa, 1) + vgetq_lane_f32(sa, 2) + vgetq_lane_f32(sa, 3);
+    *rb = vgetq_lane_f32(sb, 0) + vgetq_lane_f32(sb, 1) + vgetq_lane_f32(sb, 2) + vgetq_lane_f32(sb, 3);
+    for (; i < n; i++) {
+        *ra += x[i] * a[i];
+        *rb += x[i] * b[i];
+    }
+}
+#endif
+
+/* ----------------------- Plan ---------------------------------------------*/
+int dsp_batch_plan_init(dsp_batch_plan_t *plan, uint16_t bin, int force_scalar) {
+    if (bin >= DSP_BATCH_MAX_BIN)
+        return -1;
+    plan->num_points = DSP_NUM_POINTS;
+    plan->bin = bin;
+    plan->wcos = malloc(DSP_NUM_POINTS * sizeof(float));
+    plan->wsin = malloc(DSP_NUM_POINTS * sizeof(float));
+    if (plan->wcos == NULL || plan->wsin == NULL) {
+        dsp_batch_plan_free(plan);
+        return -1;
+    }
+    for (int n = 0; n < DSP_NUM_POINTS; n++) {
+        double x = 2.0 * PI * bin * n / DSP_NUM_POINTS;
+        plan->wcos[n] = (float)(flattop_window[n] * cos(x));
+        plan->wsin[n] = (float)(flattop_window[n] * sin(x));
+    }
+
+    plan->kernel = "scalar";
+    plan->dot2 = dot2_scalar;
+    if (force_scalar)
+        return 0;
+#ifdef DSP_BATCH_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        plan->kernel = "avx2";
+        plan->dot2 = dot2_avx2;
+    }
+#endif
+#ifdef DSP_BATCH_NEON
+    plan->kernel = "neon";
+    plan->dot2 = dot2_neon;
+#endif
+    return 0;
+}
+
+void dsp_batch_plan_free(dsp_batch_plan_t *plan) {
+    free(plan->wcos);
+    free(plan->wsin);
+    plan->wcos = plan->wsin = NULL;
+}
+
+/* ----------------------- Analysis -----------------------------------------*/
+void dsp_batch_record(const dsp_batch_plan_t *plan, const int16_t *codes, size_t stride, float scale,
+                      float *work, dsp_batch_result_t *result) {
+    int16_t min = INT16_MAX, max = INT16_MIN;
+    float re, im;
+    float bins[2 * DSP_BATCH_MAX_BIN];
+
+    for (uint16_t n = 0; n < plan->num_points; n++) {
+        int16_t c = codes[n * stride];
+        if (c < min) min = c;
+        if (c > max) max = c;
+        work[n] = c;
+    }
+    plan->dot2(work, plan->wcos, plan->wsin, plan->num_points, &re, &im);
+    re *= scale;
+    im = -im * scale;  // X(k) = sum x * w * exp(-j 2 pi k n / N)
+
+    result->rms = (max - min) * scale * 0.353f;
+    // 2 / N for the amplitude, / sqrt(2) for RMS
+    result->magnitude = sqrtf(re * re + im * im) * (1.41421356f / plan->num_points);
+
+    // myfftPhase() itself, for the same EPSILON test and correction as the firmware
+    bins[2 * plan->bin] = re;
+    bins[2 * plan->bin + 1] = im;
+    result->phase = myfftPhase(bins, plan->num_points, plan->bin);
+}
+
+typedef struct {
+    const dsp_batch_plan_t *plan;
+    const int16_t *records;
+    size_t record_stride;
+    size_t count;
+    uint16_t channels;
+    float scale;
+    dsp_batch_result_t *results;
+    pthread_mutex_t lock;
+    size_t next;
+} batch_job_t;
+
+static void *batch_worker(void *arg) {
+    batch_job_t *job = arg;
+    float *work = malloc(job->plan->num_points * sizeof(float));
+    size_t first, last;
+
+    if (work == NULL)
+        return (void *)1;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        first = job->next;
+        job->next += RECORDS_PER_TAKE;
+        pthread_mutex_unlock(&job->lock);
+        if (first >= job->count)
+            break;
+        last = first + RECORDS_PER_TAKE < job->count ? first + RECORDS_PER_TAKE : job->count;
+
+        for (size_t r = first; r < last; r++) {
+            const int16_t *record = job->records + r * job->record_stride;
+            for (uint16_t ch = 0; ch < job->channels; ch++)
+                dsp_batch_record(job->plan, record + ch, job->channels, job->scale, work,
+                                 &job->results[r * job->channels + ch]);
+        }
+    }
+    free(work);
+    return NULL;
+}
+
+int dsp_batch_run(const dsp_batch_plan_t *plan, const int16_t *records, size_t record_stride, size_t count,
+                  uint16_t channels, float scale, dsp_batch_result_t *results, int threads) {
+    batch_job_t job = { plan, records, record_stride, count, channels, scale, results,
+                        PTHREAD_MUTEX_INITIALIZER, 0 };
+    pthread_t *ids;
+    int started = 0, result = 0;
+    void *status;
+
+    if (threads < 1)
+        threads = 1;
+    ids = malloc(threads * sizeof(pthread_t));
+    if (ids == NULL)
+        return -1;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&ids[i], NULL, batch_worker, &job) != 0)
+            break;
+        started++;
+    }
+    // Without a thread at all, do it here
+    if (started == 0)
+        result = batch_worker(&job) == NULL ? 0 : -1;
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], &status);
+        if (status != NULL)
+            result = -1;
+    }
+    free(ids);
+    return result;
+}
@@ -0,0 +1,71 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Batch analysis of recorded waveforms on a PC, many records on all the cores.
+
+    Same semantics as the firmware chain (dsp_core.c): the Flat Top window of
+    flattop_window[], the phase of one bin with the correction of myfftPhase(),
+    and the RMS from the peak to peak value, (max - min) * 0.353.
+    Only the bin is computed, not the whole FFT: a windowed DFT of one bin is
+    two dot products of the samples with window * cos and window * sin, which
+    run 8 (AVX2) or 4 (NEON) samples at a time. The kernel is chosen when the
+    plan is made, from what the CPU has.
+
+    Host only (pthreads, SIMD intrinsics), the firmware does not build this file.
+*/
+
+#ifndef DSP_BATCH_H
+#define DSP_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DSP_BATCH_MAX_BIN  64  // 366 Hz, the phase correction of myfftPhase() is for bin 9
+
+typedef struct {
+    float phase;      // Degrees 0..360, as myfftPhase()
+    float rms;        // Volts, (max - min) * 0.353 like the firmware
+    float magnitude;  // Volts RMS of the bin (the Flat Top window has a coherent gain of 1)
+} dsp_batch_result_t;
+
+typedef struct {
+    uint16_t num_points;
+    uint16_t bin;
+    float *wcos;      // window[n] * cos(2 pi bin n / N)
+    float *wsin;      // window[n] * sin(2 pi bin n / N)
+    const char *kernel;  // "avx2", "neon" or "scalar"
+    void (*dot2)(const float *x, const float *a, const float *b, size_t n, float *ra, float *rb);
+} dsp_batch_plan_t;
+
+// Tables for one bin (< DSP_BATCH_MAX_BIN) with the DSP_NUM_POINTS Flat Top window.
+// `force_scalar` is for comparing the kernels. Returns 0, or -1 on error.
+int dsp_batch_plan_init(dsp_batch_plan_t *plan, uint16_t bin, int force_scalar);
+void dsp_batch_plan_free(dsp_batch_plan_t *plan);
+
+// One channel of one record. `codes` are ADC codes, `stride` apart (the number
+// of interleaved channels), volts = code * scale. `work` has num_points floats.
+void dsp_batch_record(const dsp_batch_plan_t *plan, const int16_t *codes, size_t stride, float scale,
+                      float *work, dsp_batch_result_t *result);
+
+// All channels of `count` records stored one after another (num_points x channels
+// codes each, channels interleaved), on `threads` threads. results[record * channels + channel].
+// Returns 0, or -1 on error.
+int dsp_batch_run(const dsp_batch_plan_t *plan, const int16_t *records, size_t record_stride, size_t count,
+                  uint16_t channels, float scale, dsp_batch_result_t *results, int threads);
+
+#endif
@@ -0,0 +1,80 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    DSP core shared by the firmware (treceri, TestFFTPhaseComputation) and the
+    PC tools (treceriTestPhaseComputing, unit test and benchmark).
+    Only plain C and math.h, so the same file builds with arm-none-eabi-gcc
+    in CooCox and with gcc / CMake on a PC.
+*/
+
+#ifndef DSP_CORE_H
+#define DSP_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PI        3.1415926535897932384626433832795
+#define DEG2RAD   0.01745329251994329576923690768489
+#define RAD2DEG   57.295779513082320876798154814105  // 180/PI
+#define EPSILON   1e-8 // Small value for zero comparison
+
+#define DSP_NUM_POINTS   2048  // Samples in one acquisition (and FFT length)
+#define DSP_FUNDAMENTAL_BIN 9  // 51.4984130859375 Hz, the nearest bin from 50 Hz
+
+// MCP3903 16 bit code to volts, the ADC Vref is 2.39 V and the full scale is +-Vref / 3
+static inline float adc_code_to_voltage(int16_t code) {
+    return ((float)code / 32767.0 / 3.0) * 2.39;
+}
+
+// Convert ADC codes to a Re, 0, Re, 0, ... signal for real_fft()
+void convert_adc_codes(const int16_t *codes, float *signal, uint16_t num_points);
+
+// Convert ADC codes to real samples one after the other, for real_fft_packed()
+void convert_adc_codes_packed(const int16_t *codes, float *samples, uint16_t num_points);
+
+// Flat Top window for DSP_NUM_POINTS samples
+extern const float flattop_window[DSP_NUM_POINTS];
+
+// Compute the Flat Top window coefficients (the table above was made with it)
+void generate_flat_top_window(float *window, uint16_t num_points);
+
+// Apply the Flat Top window to the real side of an interleaved Re, Im signal
+void apply_flattop_window(float *signal, const float *flattop_window, uint16_t num_points);
+
+// FFT of nn real samples stored as Re, 0, Re, 0, ... (nn must be a power of 2)
+void real_fft(float data[], unsigned long nn);
+
+// Same as apply_flattop_window() for real samples one after the other
+void apply_flattop_window_packed(float *samples, const float *flattop_window, uint16_t num_points);
+
+// FFT of n real samples in n floats (n a power of 2, 4 or more), half the memory of
+// real_fft(). Out: DC, Nyquist, then Re, Im of bins 1 to n/2-1 at data[2k], data[2k+1]
+void real_fft_packed(float data[], unsigned long n);
+
+// Phase of bin k in degrees 0..360, corrected for the 50 Hz fundamental
+float myfftPhase(float data[], unsigned long nn, uint16_t k);
+
+// Phase * 100 without the zero-cross to /DRA delay, 0 if the delay is not valid
+// (DSP_MAX_PHASE_DIFFERENCE or more)
+#define DSP_MAX_PHASE_DIFFERENCE  359.0
+uint16_t adjust_phase(float phase, float phase_difference);
+
+// RMS voltage * 10000, limited to 100 mA on the 5.6 ohm resistor
+uint16_t adjust_voltage(float voltage);
+
+#endif
@@ -0,0 +1,81 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Test signal generator (DDS) for the on-target sweeps, no sin() and no rand().
+
+    Each tone is a 32 bit phase accumulator (2^32 = one turn) that indexes a
+    quarter-wave table of 257 Q30 values with linear interpolation, about
+    5e-6 of the peak in error. The noise is uniform, from xorshift32.
+    Per sample and per tone: a table lookup, an integer multiply and a float
+    multiply-add, instead of a soft-float double sin() on the Cortex-M3.
+    Plain C like dsp_core.c, built by CooCox and by CMake.
+*/
+
+#ifndef DSP_DDS_H
+#define DSP_DDS_H
+
+#include <stdint.h>
+
+#define DSP_DDS_MAX_TONES  8  // Fundamental and harmonics
+
+typedef struct {
+    uint32_t phase;      // Accumulator, 2^32 = 360 degrees
+    uint32_t step;       // Phase increment per sample
+    float amplitude;     // Peak volts
+} dsp_dds_tone_t;
+
+typedef struct {
+    float sample_rate;
+    dsp_dds_tone_t tones[DSP_DDS_MAX_TONES];
+    uint8_t num_tones;
+    float noise_amplitude;  // Uniform noise, peak volts
+    uint32_t noise_state;   // xorshift32, never 0
+} dsp_dds_t;
+
+// Quarter-wave sine table, sin(i * 90 / 256 degrees) * 2^30
+extern const int32_t dsp_dds_quarter_sine[257];
+
+// No tones, noise_amplitude of uniform noise seeded with `seed`
+void dsp_dds_init(dsp_dds_t *dds, float sample_rate, float noise_amplitude, uint32_t seed);
+
+// Add a sine of `rms_amplitude` volts RMS, `phase_degrees` at the first sample.
+// Returns 0, or -1 when there are already DSP_DDS_MAX_TONES tones.
+int dsp_dds_add_tone(dsp_dds_t *dds, float rms_amplitude, float frequency, float phase_degrees);
+
+// Fundamental and its harmonic `order` with `relative` amplitude, in phase with it
+// (phase_degrees * order). Returns 0 or -1, see dsp_dds_add_tone().
+int dsp_dds_add_harmonic(dsp_dds_t *dds, float rms_amplitude, float frequency, float phase_degrees,
+                         uint8_t order, float relative);
+
+// Next num_points samples as Re, 0, Re, 0, ... for real_fft()
+void dsp_dds_fill(dsp_dds_t *dds, float *signal, uint16_t num_points);
+
+// sin(phase / 2^32 * 360 degrees) * 2^30
+int32_t dsp_dds_sine_q30(uint32_t phase);
+
+// xorshift32, the state must not be 0
+static inline uint32_t dsp_xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+#endif
@@ -0,0 +1,286 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Unit test of the DSP core, runs with `ctest`.
+    Returns 0 if all checks pass, prints every failed check.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "dsp_core.h"
+#include "dsp_dds.h"
+
+#define SAMPLE_RATE 11718.75  // Hz, the MCP3903 data rate
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static float data[2 * DSP_NUM_POINTS];
+
+// Sine wave as Re, 0, Re, 0, ... like the firmware loads it from the SRAM
+static void make_sine(float *signal, uint16_t num_points, float rms_amplitude, float frequency, float phase_degrees) {
+    double peak_amplitude = rms_amplitude * sqrt(2.0);
+    for (uint16_t i = 0; i < num_points; i++) {
+        double t = i / SAMPLE_RATE;
+        signal[2 * i] = peak_amplitude * sin(2.0 * PI * frequency * t + phase_degrees * DEG2RAD);
+        signal[2 * i + 1] = 0.0;
+    }
+}
+
+// Smallest difference of two angles in degrees
+static double angle_error(double a, double b) {
+    double d = fmod(a - b, 360.0);
+    if (d > 180.0) d -= 360.0;
+    if (d < -180.0) d += 360.0;
+    return fabs(d);
+}
+
+static void test_window_table(void) {
+    static float window[DSP_NUM_POINTS];
+    double max_error = 0;
+
+    generate_flat_top_window(window, DSP_NUM_POINTS);
+    for (int n = 0; n < DSP_NUM_POINTS; n++) {
+        double e = fabs(window[n] - flattop_window[n]);
+        if (e > max_error) max_error = e;
+    }
+    // The table is printed with 6 decimals
+    CHECK(max_error < 2e-6, "flattop_window table differs from the generator by %g", max_error);
+}
+
+static void test_fft_impulse(void) {
+    for (int i = 0; i < 2 * DSP_NUM_POINTS; i++) data[i] = 0.0;
+    data[0] = 1.0;
+    real_fft(data, DSP_NUM_POINTS);
+    for (int k = 0; k < DSP_NUM_POINTS; k++) {
+        CHECK(fabs(data[2 * k] - 1.0) < 1e-6 && fabs(data[2 * k + 1]) < 1e-6,
+              "impulse bin %d = %g %+gi", k, data[2 * k], data[2 * k + 1]);
+    }
+}
+
+static void test_fft_against_dft(void) {
+    enum { N = 64 };
+    float x[2 * N];
+    float input[N];
+
+    srand(1);
+    for (int i = 0; i < N; i++) {
+        input[i] = (float)rand() / RAND_MAX - 0.5f;
+        x[2 * i] = input[i];
+        x[2 * i + 1] = 0.0;
+    }
+    real_fft(x, N);
+    for (int k = 0; k < N; k++) {
+        double re = 0, im = 0;
+        for (int n = 0; n < N; n++) {
+            re += input[n] * cos(2.0 * PI * k * n / N);
+            im -= input[n] * sin(2.0 * PI * k * n / N);
+        }
+        CHECK(fabs(x[2 * k] - re) < 1e-4 && fabs(x[2 * k + 1] - im) < 1e-4,
+              "bin %d: fft %g %+gi, dft %g %+gi", k, x[2 * k], x[2 * k + 1], re, im);
+    }
+}
+
+static void test_fft_bin_cosine(void) {
+    // Exactly on bin 9, amplitude 0.1: X(9) = 0.1 * N / 2, the other bins are 0
+    for (int i = 0; i < DSP_NUM_POINTS; i++) {
+        data[2 * i] = 0.1 * cos(2.0 * PI * DSP_FUNDAMENTAL_BIN * i / DSP_NUM_POINTS);
+        data[2 * i + 1] = 0.0;
+    }
+    real_fft(data, DSP_NUM_POINTS);
+    CHECK(fabs(data[2 * DSP_FUNDAMENTAL_BIN] - 0.1 * DSP_NUM_POINTS / 2) < 1e-3,
+          "bin 9 = %g", data[2 * DSP_FUNDAMENTAL_BIN]);
+    CHECK(fabs(data[2 * 20]) < 1e-3 && fabs(data[2 * 20 + 1]) < 1e-3,
+          "bin 20 = %g %+gi", data[2 * 20], data[2 * 20 + 1]);
+}
+
+static void test_phase_50hz(void) {
+    double max_error = 0;
+
+    // The same chain as the firmware: window, FFT, phase of bin 9
+    for (int p = 0; p < 360; p += 5) {
+        make_sine(data, DSP_NUM_POINTS, 0.025, 50.0, p);
+        apply_flattop_window(data, flattop_window, DSP_NUM_POINTS);
+        real_fft(data, DSP_NUM_POINTS);
+        double e = angle_error(myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN), p);
+        if (e > max_error) max_error = e;
+    }
+    CHECK(max_error < 0.1, "50 Hz phase error %g degrees", max_error);
+}
+
+static void test_fft_packed_against_dft(void) {
+    enum { N = 64 };
+    float x[N];
+    float input[N];
+
+    srand(2);
+    for (int i = 0; i < N; i++) {
+        input[i] = (float)rand() / RAND_MAX - 0.5f;
+        x[i] = input[i];
+    }
+    real_fft_packed(x, N);
+    for (int k = 0; k <= N / 2; k++) {
+        double re = 0, im = 0;
+        for (int n = 0; n < N; n++) {
+            re += input[n] * cos(2.0 * PI * k * n / N);
+            im -= input[n] * sin(2.0 * PI * k * n / N);
+        }
+        // DC and Nyquist are real and share the first pair
+        double fre = (k == 0) ? x[0] : (k == N / 2) ? x[1] : x[2 * k];
+        double fim = (k == 0 || k == N / 2) ? 0.0 : x[2 * k + 1];
+        CHECK(fabs(fre - re) < 1e-4 && fabs(fim - im) < 1e-4,
+              "packed bin %d: fft %g %+gi, dft %g %+gi", k, fre, fim, re, im);
+    }
+}
+
+static void test_phase_50hz_packed(void) {
+    static float packed[DSP_NUM_POINTS];
+    double max_error = 0, max_difference = 0;
+
+    // The firmware chain in half the memory gives the phase of the full one
+    for (int p = 0; p < 360; p += 5) {
+        make_sine(data, DSP_NUM_POINTS, 0.025, 50.0, p);
+        for (int i = 0; i < DSP_NUM_POINTS; i++)
+            packed[i] = data[2 * i];
+        apply_flattop_window(data, flattop_window, DSP_NUM_POINTS);
+        real_fft(data, DSP_NUM_POINTS);
+        apply_flattop_window_packed(packed, flattop_window, DSP_NUM_POINTS);
+        real_fft_packed(packed, DSP_NUM_POINTS);
+        double phase = myfftPhase(packed, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN);
+        double e = angle_error(phase, p);
+        double d = angle_error(phase, myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN));
+        if (e > max_error) max_error = e;
+        if (d > max_difference) max_difference = d;
+    }
+    CHECK(max_error < 0.1, "packed 50 Hz phase error %g degrees", max_error);
+    CHECK(max_difference < 0.001, "packed and full FFT phases differ by %g degrees", max_difference);
+}
+
+static void test_phase_limits(void) {
+    for (int i = 0; i < 2 * DSP_NUM_POINTS; i++) data[i] = 0.0;
+    CHECK(myfftPhase(data, DSP_NUM_POINTS, 9) == 0.0, "phase of an empty bin is not 0");
+    data[2 * 1024] = 1.0;
+    CHECK(myfftPhase(data, DSP_NUM_POINTS, 1024) == 0.0, "phase of bin nn/2 is not 0");
+}
+
+static void test_convert(void) {
+    const int16_t codes[3] = { 32767, 0, -32767 };
+    float signal[6] = { 1, 1, 1, 1, 1, 1 };
+
+    convert_adc_codes(codes, signal, 3);
+    CHECK(fabs(signal[0] - 2.39 / 3.0) < 1e-6, "full scale code = %g V", signal[0]);
+    CHECK(signal[2] == 0.0 && signal[1] == 0.0 && signal[3] == 0.0, "zero code or imaginary side not 0");
+    CHECK(fabs(signal[4] + 2.39 / 3.0) < 1e-6, "negative full scale code = %g V", signal[4]);
+}
+
+static void test_adjust(void) {
+    CHECK(adjust_phase(100.0, 0.5) == 9950, "adjust_phase(100, 0.5) = %u", adjust_phase(100.0, 0.5));
+    CHECK(adjust_phase(10.0, 20.0) == 35000, "adjust_phase(10, 20) = %u", adjust_phase(10.0, 20.0));
+    CHECK(adjust_phase(10.0, 359.0) == 0, "adjust_phase with a broken delay is not 0");
+
+    CHECK(adjust_voltage(-0.1) == 0, "adjust_voltage(-0.1) = %u", adjust_voltage(-0.1));
+    CHECK(adjust_voltage(0.25) == 2500, "adjust_voltage(0.25) = %u", adjust_voltage(0.25));
+    CHECK(adjust_voltage(1.0) == 5600, "adjust_voltage(1.0) = %u", adjust_voltage(1.0));
+}
+
+static void test_dds_sine(void) {
+    double max_error = 0;
+
+    for (uint32_t i = 0; i < 100000; i++) {
+        uint32_t phase = i * 42949u + (i >> 3);  // All quadrants, odd fractions
+        double e = fabs(dsp_dds_sine_q30(phase) / 1073741824.0 - sin(phase / 4294967296.0 * 2.0 * PI));
+        if (e > max_error) max_error = e;
+    }
+    CHECK(max_error < 1e-5, "DDS sine error %g", max_error);
+    CHECK(dsp_dds_sine_q30(0x40000000) == 1073741824, "DDS sine(90) = %d", dsp_dds_sine_q30(0x40000000));
+    CHECK(dsp_dds_sine_q30(0xC0000000) == -1073741824, "DDS sine(270) = %d", dsp_dds_sine_q30(0xC0000000));
+}
+
+static void test_dds_signal(void) {
+    static float reference[2 * DSP_NUM_POINTS];
+    dsp_dds_t dds;
+    double max_error = 0, sum = 0;
+
+    // The same signal as make_sine(), 25 mV RMS, 50 Hz, 30 degrees
+    dsp_dds_init(&dds, SAMPLE_RATE, 0.0, 1);
+    CHECK(dsp_dds_add_tone(&dds, 0.025, 50.0, 30.0) == 0, "cannot add a tone");
+    dsp_dds_fill(&dds, data, DSP_NUM_POINTS);
+    make_sine(reference, DSP_NUM_POINTS, 0.025, 50.0, 30.0);
+    for (int i = 0; i < 2 * DSP_NUM_POINTS; i++) {
+        double e = fabs(data[i] - reference[i]);
+        if (e > max_error) max_error = e;
+    }
+    CHECK(max_error < 0.035 * 2e-5, "DDS signal error %g V", max_error);
+
+    // The firmware chain sees the same phase, also with harmonics
+    dsp_dds_init(&dds, SAMPLE_RATE, 0.0, 1);
+    dsp_dds_add_harmonic(&dds, 0.025, 50.0, 123.0, 3, 0.10);
+    dsp_dds_add_harmonic(&dds, 0.025, 50.0, 123.0, 5, 0.05);
+    dsp_dds_add_tone(&dds, 0.025, 50.0, 123.0);
+    dsp_dds_fill(&dds, data, DSP_NUM_POINTS);
+    apply_flattop_window(data, flattop_window, DSP_NUM_POINTS);
+    real_fft(data, DSP_NUM_POINTS);
+    double e = angle_error(myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN), 123.0);
+    CHECK(e < 0.1, "DDS with harmonics, phase error %g degrees", e);
+
+    // Noise only: inside the amplitude, mean near 0
+    dsp_dds_init(&dds, SAMPLE_RATE, 0.002, 12345);
+    dsp_dds_fill(&dds, data, DSP_NUM_POINTS);
+    max_error = 0;
+    for (int i = 0; i < DSP_NUM_POINTS; i++) {
+        if (fabs(data[2 * i]) > max_error) max_error = fabs(data[2 * i]);
+        sum += data[2 * i];
+    }
+    CHECK(max_error <= 0.002 && max_error > 0.0019, "DDS noise peak %g V", max_error);
+    CHECK(fabs(sum / DSP_NUM_POINTS) < 0.0001, "DDS noise mean %g V", sum / DSP_NUM_POINTS);
+
+    for (int i = 0; i < DSP_DDS_MAX_TONES; i++)
+        dsp_dds_add_tone(&dds, 0.01, 50.0, 0.0);
+    CHECK(dsp_dds_add_tone(&dds, 0.01, 50.0, 0.0) == -1, "more than DSP_DDS_MAX_TONES tones");
+}
+
+int main(void) {
+    test_window_table();
+    test_fft_impulse();
+    test_fft_against_dft();
+    test_fft_bin_cosine();
+    test_phase_50hz();
+    test_fft_packed_against_dft();
+    test_phase_50hz_packed();
+    test_phase_limits();
+    test_convert();
+    test_adjust();
+    test_dds_sine();
+    test_dds_signal();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Writes the golden vectors of the DSP regression suite (golden_test.c).
+
+    Usage: golden_gen [--out NAME] [--seed S]
+        --out    output name without extension (default golden_vectors)
+        --seed   seed of the noise (default 1)
+
+    NAME.cap   one INT16 record of 2048 ADC codes for each signal (capture_file.h),
+               the label is the phase of the generated signal
+    NAME.csv   the reference values of each record, in double precision:
+                   phase_true   phase of the generated signal at the first sample
+                   phase_ref    the firmware method (Flat Top window, bin 9, corrected
+                                for 50 Hz) computed with a double precision DFT
+                   rms_true     RMS of the quantised signal
+                   rms_ref      the firmware estimator, (max - min) * 0.353
+
+    The phase correction of the reference is computed, not the 137.1126 of
+    myfftPhase(): a 50 Hz sine in bin 9 (51.498 Hz) of the windowed FFT is
+    -90 degrees (sine to cosine) and -180 * (fbin - 50) * (N - 1) / fs behind.
+    Nothing here uses dsp_core.c, so a change in the core cannot move the
+    reference with it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "capture_file.h"
+
+#define PI           3.1415926535897932384626433832795
+
+#define N            2048
+#define BIN          9
+#define SAMPLE_RATE  11718.75              // Hz, the MCP3903 data rate
+#define VOLTS_PER_CODE (2.39 / 3.0 / 32767.0)
+
+static const double amplitudes[] = { 0.02, 0.05, 0.1, 0.3, 0.55 };  // Volts RMS
+static const double frequencies[] = { 50.0, 49.9, 50.1 };
+static const double noises[] = { 0.0, 0.0005, 0.002 };           // Peak volts
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+#define NUM_RECORDS 60
+
+static uint64_t rng_state;
+
+// xorshift64*, uniform in [-1, 1)
+static double rng_uniform(void) {
+    uint64_t x = rng_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng_state = x;
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / 4503599627370496.0 - 1.0;
+}
+
+static double wrap360(double degrees) {
+    degrees = fmod(degrees, 360.0);
+    return degrees < 0.0 ? degrees + 360.0 : degrees;
+}
+
+// Phase of bin BIN with the Flat Top window, corrected for a 50 Hz signal
+static double reference_phase(const double *v) {
+    const double a[5] = { 1.0, 1.93, 1.29, 0.388, 0.028 };
+    double re = 0.0, im = 0.0;
+    double bin_frequency = BIN * SAMPLE_RATE / N;
+
+    for (int n = 0; n < N; n++) {
+        double f = 2.0 * PI * n / (N - 1);
+        double w = a[0] - a[1] * cos(f) + a[2] * cos(2 * f) - a[3] * cos(3 * f) + a[4] * cos(4 * f);
+        double x = 2.0 * PI * BIN * n / N;
+        re += w * v[n] * cos(x);
+        im -= w * v[n] * sin(x);
+    }
+    return wrap360(atan2(im, re) * 180.0 / PI + 90.0 + 180.0 * (bin_frequency - 50.0) * (N - 1) / SAMPLE_RATE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = "golden_vectors";
+    uint64_t seed = 1;
+    char path[512];
+    capture_file_t *capture;
+    FILE *csv;
+    static int16_t codes[N];
+    static double v[N];
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            name = argv[++i];
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [--out NAME] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    snprintf(path, sizeof(path), "%s.cap", name);
+    capture = capture_create(path, SAMPLE_RATE, 1, CAPTURE_INT16, N, VOLTS_PER_CODE);
+    if (capture == NULL)
+        return 1;
+    snprintf(path, sizeof(path), "%s.csv", name);
+    csv = fopen(path, "w");
+    if (csv == NULL) {
+        perror(path);
+        return 1;
+    }
+    fprintf(csv, "record,amplitude,frequency,noise,h3,phase_true,phase_ref,rms_true,rms_ref\n");
+
+    for (int r = 0; r < NUM_RECORDS; r++) {
+        double amplitude = amplitudes[r % COUNT(amplitudes)];
+        double frequency = frequencies[(r / COUNT(amplitudes)) % COUNT(frequencies)];
+        double noise = noises[(r / 15) % COUNT(noises)];
+        double h3 = (r % 4 == 3) ? 0.05 : 0.0;  // 5 % third harmonic
+        double phase = wrap360(r * 47.3 + 0.25);
+        double min = 1e30, max = -1e30, sum_sq = 0.0;
+
+        for (int n = 0; n < N; n++) {
+            double x = 2.0 * PI * frequency * n / SAMPLE_RATE + phase * PI / 180.0;
+            double volts = amplitude * sqrt(2.0) * (sin(x) + h3 * sin(3.0 * x)) + noise * rng_uniform();
+            double code = nearbyint(volts / VOLTS_PER_CODE);
+
+            codes[n] = (int16_t)(code > 32767 ? 32767 : (code < -32768 ? -32768 : code));
+            v[n] = codes[n] * VOLTS_PER_CODE;
+            if (v[n] < min) min = v[n];
+            if (v[n] > max) max = v[n];
+            sum_sq += v[n] * v[n];
+        }
+        if (capture_write(capture, (float)phase, r, codes) != 0)
+            return 1;
+        fprintf(csv, "%d,%.4f,%.2f,%.4f,%.2f,%.9f,%.9f,%.9f,%.9f\n", r, amplitude, frequency, noise, h3,
+                phase, reference_phase(v), sqrt(sum_sq / N), (max - min) * 0.353);
+    }
+    fclose(csv);
+    if (capture_close(capture) != 0)
+        return 1;
+    printf("%d golden records in %s.cap and %s.csv\n", NUM_RECORDS, name, name);
+    return 0;
+}
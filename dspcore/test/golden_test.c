@@ -0,0 +1,248 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Checks every variant of the DSP chain against the golden vectors of golden_gen.c.
+
+    Usage: golden_test [NAME]     (default golden_vectors, reads NAME.cap and NAME.csv)
+
+    A variant turns the 2048 ADC codes of a record into the phase (degrees) and
+    RMS (volts) the firmware would publish. Each one has its own tolerance from
+    the double precision reference: the float FFT is not exact, and the Modbus
+    registers have 0.01 degree and 0.1 mV steps.
+    A new kernel (fixed point, Goertzel, ...) is one more entry in
+    `variants[]`; if its numbers move, the test shows by how much.
+
+    Built twice: with dsp_core.c (golden_test), and with the single file copy
+    calculatePhaseFromFFT_TEST_ME.c (golden_test_me, GOLDEN_TEST_ME), which has
+    no ADC conversion nor window table, only the float chain runs there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dsp_core.h"
+#include "capture_file.h"
+#ifndef GOLDEN_TEST_ME
+#include "dsp_batch.h"
+#endif
+
+typedef struct {
+    double frequency;
+    double noise;
+    double phase_true;
+    double phase_ref;
+    double rms_true;
+    double rms_ref;
+} golden_ref_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(const int16_t *codes, double *phase, double *rms);
+    double phase_tolerance;  // Degrees
+    double rms_tolerance;    // Volts
+} golden_variant_t;
+
+// Reference phase against the generated one, for the 50 Hz records without noise
+#define REFERENCE_TOLERANCE 0.005
+
+static float window[DSP_NUM_POINTS];
+static float data[2 * DSP_NUM_POINTS];
+static float scale;  // Volts per code, from the capture header
+
+// Peak to peak estimator of the firmware, on every `stride` float of data
+// (2 for the Re side of Re, Im data, 1 for the samples of real_fft_packed())
+static double peak_rms(int stride) {
+    float min = 1000.0, max = -1000.0;
+
+    for (int i = 0; i < DSP_NUM_POINTS; i++) {
+        if (data[stride * i] > max) max = data[stride * i];
+        if (data[stride * i] < min) min = data[stride * i];
+    }
+    return (max - min) * 0.353;
+}
+
+/* ----------------------- Variants -----------------------------------------*/
+// Window from generate_flat_top_window(), float FFT
+static void run_float_chain(const int16_t *codes, double *phase, double *rms) {
+    for (int i = 0; i < DSP_NUM_POINTS; i++) {
+        data[2 * i] = codes[i] * scale;
+        data[2 * i + 1] = 0.0;
+    }
+    *rms = peak_rms(2);
+    apply_flattop_window(data, window, DSP_NUM_POINTS);
+    real_fft(data, DSP_NUM_POINTS);
+    *phase = myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN);
+}
+
+#ifndef GOLDEN_TEST_ME
+// What treceri/main.c publishes: window table, packed FFT, and the Modbus register values
+static void run_firmware(const int16_t *codes, double *phase, double *rms) {
+    convert_adc_codes_packed(codes, data, DSP_NUM_POINTS);
+    *rms = adjust_voltage(peak_rms(1)) / 10000.0;
+    apply_flattop_window_packed(data, flattop_window, DSP_NUM_POINTS);
+    real_fft_packed(data, DSP_NUM_POINTS);
+    *phase = adjust_phase(myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN), 0.0) / 100.0;
+}
+
+// Batch engine, one bin DFT with the SIMD kernel of this CPU and the scalar one
+static dsp_batch_plan_t batch_simd, batch_scalar;
+
+static void run_batch(const dsp_batch_plan_t *plan, const int16_t *codes, double *phase, double *rms) {
+    dsp_batch_result_t result;
+
+    dsp_batch_record(plan, codes, 1, scale, data, &result);
+    *phase = result.phase;
+    *rms = result.rms;
+}
+
+static void run_batch_simd(const int16_t *codes, double *phase, double *rms) {
+    run_batch(&batch_simd, codes, phase, rms);
+}
+
+static void run_batch_scalar(const int16_t *codes, double *phase, double *rms) {
+    run_batch(&batch_scalar, codes, phase, rms);
+}
+#endif
+
+static const golden_variant_t variants[] = {
+    { "float_chain", run_float_chain, 0.005, 2e-6 },
+#ifndef GOLDEN_TEST_ME
+    { "firmware",    run_firmware,    0.02, 1.5e-4 },
+    { "batch_simd",  run_batch_simd,  0.005, 2e-6 },
+    { "batch_scalar", run_batch_scalar, 0.005, 2e-6 },
+#endif
+};
+#define NUM_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+/* ----------------------- Runner -------------------------------------------*/
+// Smallest difference of two angles in degrees
+static double angle_error(double a, double b) {
+    double d = fmod(a - b, 360.0);
+    if (d > 180.0) d -= 360.0;
+    if (d < -180.0) d += 360.0;
+    return fabs(d);
+}
+
+static golden_ref_t *read_references(const char *path, uint32_t records) {
+    golden_ref_t *refs = calloc(records, sizeof(golden_ref_t));
+    FILE *csv = fopen(path, "r");
+    char line[512];
+    uint32_t count = 0;
+
+    if (csv == NULL || refs == NULL) {
+        perror(path);
+        free(refs);
+        return NULL;
+    }
+    // record,amplitude,frequency,noise,h3,phase_true,phase_ref,rms_true,rms_ref
+    while (fgets(line, sizeof(line), csv) && count < records) {
+        golden_ref_t *g = &refs[count];
+        unsigned record;
+        double amplitude, h3;
+
+        if (sscanf(line, "%u,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf", &record, &amplitude, &g->frequency, &g->noise,
+                   &h3, &g->phase_true, &g->phase_ref, &g->rms_true, &g->rms_ref) == 9)
+            count++;
+    }
+    fclose(csv);
+    if (count != records) {
+        fprintf(stderr, "%s: %u references for %u records\n", path, count, records);
+        free(refs);
+        return NULL;
+    }
+    return refs;
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = argc > 1 ? argv[1] : "golden_vectors";
+    char path[512];
+    capture_file_t *capture;
+    capture_record_t record;
+    golden_ref_t *refs;
+    static int16_t codes[DSP_NUM_POINTS];
+    double max_phase[NUM_VARIANTS] = { 0 }, max_rms[NUM_VARIANTS] = { 0 };
+    uint32_t records;
+    int failures = 0;
+
+    snprintf(path, sizeof(path), "%s.cap", name);
+    capture = capture_open(path);
+    if (capture == NULL)
+        return 1;
+    if (capture->header.channels != 1 || capture->header.sample_format != CAPTURE_INT16 ||
+        capture->header.samples != DSP_NUM_POINTS) {
+        fprintf(stderr, "%s: expected one channel of %d ADC codes\n", path, DSP_NUM_POINTS);
+        return 1;
+    }
+    scale = capture->header.scale;
+    records = capture->header.records;
+    snprintf(path, sizeof(path), "%s.csv", name);
+    refs = read_references(path, records);
+    if (refs == NULL)
+        return 1;
+
+    generate_flat_top_window(window, DSP_NUM_POINTS);
+#ifndef GOLDEN_TEST_ME
+    if (dsp_batch_plan_init(&batch_simd, DSP_FUNDAMENTAL_BIN, 0) != 0 ||
+        dsp_batch_plan_init(&batch_scalar, DSP_FUNDAMENTAL_BIN, 1) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    printf("batch kernel: %s\n", batch_simd.kernel);
+#endif
+
+    for (uint32_t r = 0; r < records; r++) {
+        if (capture_read(capture, &record, codes) != 1) {
+            fprintf(stderr, "Cannot read record %u\n", r);
+            return 1;
+        }
+        // The reference itself: at 50 Hz without noise the method gives the phase of the signal
+        if (refs[r].frequency == 50.0 && refs[r].noise == 0.0 && angle_error(refs[r].phase_ref, refs[r].phase_true) > REFERENCE_TOLERANCE) {
+            printf("FAIL reference record %u: %.4f, generated %.4f\n", r, refs[r].phase_ref, refs[r].phase_true);
+            failures++;
+        }
+        for (size_t v = 0; v < NUM_VARIANTS; v++) {
+            double phase, rms, e_phase, e_rms;
+
+            variants[v].run(codes, &phase, &rms);
+            e_phase = angle_error(phase, refs[r].phase_ref);
+            e_rms = fabs(rms - refs[r].rms_ref);
+            if (e_phase > max_phase[v]) max_phase[v] = e_phase;
+            if (e_rms > max_rms[v]) max_rms[v] = e_rms;
+            if (e_phase > variants[v].phase_tolerance || e_rms > variants[v].rms_tolerance) {
+                printf("FAIL %s record %u: phase %.4f (ref %.4f), rms %.6f (ref %.6f)\n", variants[v].name,
+                       r, phase, refs[r].phase_ref, rms, refs[r].rms_ref);
+                failures++;
+            }
+        }
+    }
+    capture_close(capture);
+
+    printf("%-13s %12s %12s %12s %12s\n", "variant", "max dphase", "tolerance", "max drms", "tolerance");
+    for (size_t v = 0; v < NUM_VARIANTS; v++)
+        printf("%-13s %12.5f %12.5f %12.2e %12.2e\n", variants[v].name, max_phase[v],
+               variants[v].phase_tolerance, max_rms[v], variants[v].rms_tolerance);
+    free(refs);
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All %u golden records passed\n", records);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include "stm32f10x.h"
+#include "main.h"
+#include "hal.h"
+#include "calibration.h"
+#include "port.h"
+#include "mbcrc.h"
+#include "dsp_core.h"
+#include <math.h>
+#ifndef HAL_SIM
+#include "stm32f10x_flash.h"
+#endif
+
+// Layout of the flash page, half words
+#define CAL_MAGIC         0xCA1B
+#define CAL_VERSION       1
+#define CAL_WORDS         (3 + CAL_CHANNELS)  // magic, version, offsets, CRC
+
+#define CAL_MIN_RMS       0.015  // Volts, the same minimum as the published phase
+
+static uint8_t cal_channels;     // Bit n: measuring CHn
+static uint16_t cal_count;       // Captures so far
+static float cal_sum[CAL_CHANNELS];
+
+// Difference of two angles, -180..180
+static float wrap180(float d) {
+    while (d >= 180.0f) d -= 360.0f;
+    while (d < -180.0f) d += 360.0f;
+    return d;
+}
+
+static uint16_t cal_crc(const uint16_t *words) {
+    return usMBCRC16((UCHAR *)words, (CAL_WORDS - 1) * 2);
+}
+
+static uint16_t cal_load(void) {
+    const uint16_t *page = HAL_CAL_DATA;
+    uint8_t i;
+
+    if (page[0] != CAL_MAGIC || page[1] != CAL_VERSION || page[CAL_WORDS - 1] != cal_crc(page))
+        return CAL_STATUS_NONE;
+    for (i = 0; i < CAL_CHANNELS; i++)
+        writeHoldingRegister(REG_CAL_OFFSET + i, page[2 + i]);
+    return CAL_STATUS_LOADED;
+}
+
+static uint16_t cal_save(void) {
+    uint16_t words[CAL_WORDS];
+    uint8_t i;
+
+    words[0] = CAL_MAGIC;
+    words[1] = CAL_VERSION;
+    for (i = 0; i < CAL_CHANNELS; i++)
+        words[2 + i] = readHoldingRegister(REG_CAL_OFFSET + i);
+    words[CAL_WORDS - 1] = cal_crc(words);
+    if (Flash_WriteCalPage(words, CAL_WORDS) != 0)
+        return CAL_STATUS_FLASH_ERR;
+    return cal_load() == CAL_STATUS_LOADED ? CAL_STATUS_SAVED : CAL_STATUS_FLASH_ERR;
+}
+
+void Cal_Init(void) {
+    uint8_t i;
+
+    for (i = 0; i < CAL_CHANNELS; i++)
+        writeHoldingRegister(REG_CAL_OFFSET + i, 0);
+    writeHoldingRegister(REG_CAL_AVERAGE, CAL_AVERAGE_DEFAULT);
+    writeHoldingRegister(REG_CAL_STATUS, cal_load());
+    cal_channels = 0;
+}
+
+void Cal_Poll(void) {
+    uint16_t command = readHoldingRegister(REG_CAL_COMMAND);
+    uint8_t i;
+
+    if (command == 0 || cal_channels != 0)
+        return;  // Nothing new, or a measurement is running (the command reads back 0 after it)
+
+    if (command >= CAL_CMD_CHANNEL && command <= CAL_CMD_ALL) {
+        cal_channels = (command == CAL_CMD_ALL) ? (1 << CAL_CHANNELS) - 1 : 1 << (command - CAL_CMD_CHANNEL);
+        cal_count = 0;
+        for (i = 0; i < CAL_CHANNELS; i++)
+            cal_sum[i] = 0.0f;
+        writeHoldingRegister(REG_CAL_STATUS, CAL_STATUS_MEASURING);
+        return;
+    }
+
+    if (command == CAL_CMD_SAVE) {
+        writeHoldingRegister(REG_CAL_STATUS, cal_save());
+    } else if (command == CAL_CMD_LOAD) {
+        writeHoldingRegister(REG_CAL_STATUS, cal_load());
+    } else if (command == CAL_CMD_CLEAR) {
+        for (i = 0; i < CAL_CHANNELS; i++)
+            writeHoldingRegister(REG_CAL_OFFSET + i, 0);
+        writeHoldingRegister(REG_CAL_STATUS, CAL_STATUS_NONE);
+    } else {
+        writeHoldingRegister(REG_CAL_STATUS, CAL_STATUS_BAD_CMD);
+    }
+    writeHoldingRegister(REG_CAL_COMMAND, 0);
+}
+
+void Cal_Measure(const float *phase, const float *rms, float phase_difference) {
+    float reference = readHoldingRegister(REG_CAL_REF_PHASE) / 100.0f;
+    uint16_t average = readHoldingRegister(REG_CAL_AVERAGE);
+    uint8_t i;
+
+    if (cal_channels == 0)
+        return;
+    // The capture is published with phase 0 (HEALTH_PHASE_REJECTED), it does not count
+    if (phase_difference >= DSP_MAX_PHASE_DIFFERENCE)
+        return;
+    if (average < 1) average = 1;
+    if (average > 100) average = 100;
+
+    for (i = 0; i < CAL_CHANNELS; i++) {
+        if (!(cal_channels & (1 << i)))
+            continue;
+        if (rms[i] <= CAL_MIN_RMS) {
+            // Nothing to measure, keep the old offsets
+            cal_channels = 0;
+            writeHoldingRegister(REG_CAL_STATUS, CAL_STATUS_NO_SIGNAL);
+            writeHoldingRegister(REG_CAL_COMMAND, 0);
+            return;
+        }
+        // The phase as it is published without calibration, minus the known one
+        cal_sum[i] += wrap180(phase[i] - phase_difference - reference);
+    }
+
+    if (++cal_count < average)
+        return;
+    for (i = 0; i < CAL_CHANNELS; i++) {
+        if (cal_channels & (1 << i))
+            writeHoldingRegister(REG_CAL_OFFSET + i, (uint16_t)(int16_t)lrintf(cal_sum[i] / cal_count * 100.0f));
+    }
+    cal_channels = 0;
+    writeHoldingRegister(REG_CAL_STATUS, CAL_STATUS_MEASURED);
+    writeHoldingRegister(REG_CAL_COMMAND, 0);
+}
+
+float Cal_Correct(uint8_t channel, float phase) {
+    float corrected = phase - (int16_t)readHoldingRegister(REG_CAL_OFFSET + channel) / 100.0f;
+
+    while (corrected >= 360.0f) corrected -= 360.0f;
+    while (corrected < 0.0f) corrected += 360.0f;
+    return corrected;
+}
+
+#ifndef HAL_SIM
+// Erase the page and write the half words, 0 = OK. The flash stalls the CPU
+// (and the interrupts) while it erases, about 20 ms.
+int Flash_WriteCalPage(const uint16_t *data, uint16_t count) {
+    uint32_t address = HAL_CAL_PAGE;
+    FLASH_Status status;
+    uint16_t i;
+
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+    status = FLASH_ErasePage(address);
+    for (i = 0; i < count && status == FLASH_COMPLETE; i++, address += 2)
+        status = FLASH_ProgramHalfWord(address, data[i]);
+    FLASH_Lock();
+    return status == FLASH_COMPLETE ? 0 : -1;
+}
+#endif
@@ -0,0 +1,68 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Per board phase calibration.
+ *
+ * The published phase only has the STM32 delay removed, from the zero-cross
+ * edge to the first /DRA (CPUTicks). The zero-cross board (optocoupler and
+ * comparator), the MCP3903 sinc filter and the analog input add a delay of
+ * their own. We measure them all at once: the master injects a signal of a
+ * known phase (to the mains zero-cross) on one or all channels, writes that
+ * phase to REG_CAL_REF_PHASE and a command to REG_CAL_COMMAND. The mean error
+ * over REG_CAL_AVERAGE captures becomes the offset of the channel, in
+ * degrees at 50 Hz, subtracted from every published phase after that.
+ *
+ * CAL_CMD_SAVE keeps the offsets in the last flash page, they are loaded
+ * at reset, so the first capture is already corrected.
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+
+// REG_CAL_COMMAND
+#define CAL_CMD_CHANNEL       1     // 1..6 measure the offset of CH0..CH5
+#define CAL_CMD_ALL           7     // Measure all the channels, same signal on all
+#define CAL_CMD_SAVE          8     // Write the offsets to the flash (the board is away ~40 ms)
+#define CAL_CMD_LOAD          9     // Read them back from the flash
+#define CAL_CMD_CLEAR         10    // All the offsets to 0, the flash is not touched
+
+// REG_CAL_STATUS
+#define CAL_STATUS_NONE       0     // No table in the flash, offsets 0
+#define CAL_STATUS_LOADED     1     // Offsets from the flash
+#define CAL_STATUS_MEASURING  2
+#define CAL_STATUS_MEASURED   3     // New offsets, not saved yet
+#define CAL_STATUS_SAVED      4
+#define CAL_STATUS_NO_SIGNAL  0x8001  // A measured channel was under the minimum level
+#define CAL_STATUS_FLASH_ERR  0x8002  // Erase or write failed
+#define CAL_STATUS_BAD_CMD    0x8003
+
+#define CAL_CHANNELS          6
+
+// Offsets from the flash to the registers, at reset
+void Cal_Init(void);
+// The commands written by the master, from the main loop
+void Cal_Poll(void);
+// After each capture: phases from myfftPhase(), RMS volts, the CPUTicks delay in degrees.
+// A capture with the delay out of range (DSP_MAX_PHASE_DIFFERENCE) is skipped.
+void Cal_Measure(const float *phase, const float *rms, float phase_difference);
+// Phase minus the offset of the channel, 0..360
+float Cal_Correct(uint8_t channel, float phase);
+
+#endif
@@ -187,7 +187,8 @@ void Default_Reset_Handler(void)
   /* Initialize data and bss */
   unsigned long *pulSrc, *pulDest;
 
-  /* Copy the data segment initializers from flash to SRAM */
+  /* Copy the data segment initializers from flash to SRAM, with the code
+     run from SRAM (.ramfunc at the start of .data, see arm-gcc-link.ld) */
   pulSrc = &_sidata;
 
   for(pulDest = &_sdata; pulDest < &_edata; )
@@ -0,0 +1,173 @@
+# Reader and decoder of the event trace of the treceri board (trace.h).
+#
+# Usage:
+#   python decode_trace.py COM5               read the trace over Modbus RTU (needs pyserial)
+#   python decode_trace.py trace.txt          decode registers saved before
+#   options: --slave N     Modbus address (default 8)
+#            --baud N      (default 19200)
+#            --save FILE   also save the registers, one per line
+#            --keep        do not clear the ring after reading it
+#
+# Registers at address 600 (see main.h): control, mask, head, count,
+# number of entries, cycles per us, then 4 per entry: time high, time low,
+# event id, argument. The board is stopped while the ring is read.
+
+import struct
+import sys
+import os
+
+TRACE_ADDRESS = 600
+TRACE_CONTROL = 0
+TRACE_HEAD = 2
+TRACE_COUNT = 3
+TRACE_NUM_ENTRIES = 4
+TRACE_CLOCK_MHZ = 5
+TRACE_DATA = 6
+TRACE_STOP = 0x0001
+TRACE_CLEAR = 0x0002
+
+MAX_READ = 125  # Registers in one Modbus read
+
+EVENTS = {
+    1: 'modbus',
+    2: 'zero-cross',
+    3: 'step',
+    4: 'capture start',
+    5: 'capture end',
+    6: 'channel start',
+    7: 'channel end',
+    8: 'publish',
+}
+MB_EVENTS = {0: 'ready', 1: 'frame received', 2: 'execute', 3: 'reply sent'}
+
+# Events that end a span, with the event that starts it
+SPANS = {5: 4, 7: 6}
+
+# Modbus CRC16
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+class ModbusRTU:
+    def __init__(self, port, slave, baud):
+        import serial
+        self.serial = serial.Serial(port, baud, timeout=1.0)
+        self.slave = slave
+
+    def request(self, pdu, reply_length):
+        frame = bytes([self.slave]) + pdu
+        self.serial.reset_input_buffer()
+        self.serial.write(frame + struct.pack('<H', crc16(frame)))
+        reply = self.serial.read(reply_length)
+        if len(reply) < 5 or crc16(reply[:-2]) != struct.unpack('<H', reply[-2:])[0]:
+            raise IOError('no reply or bad CRC')
+        if reply[1] & 0x80:
+            raise IOError('exception %d' % reply[2])
+        return reply
+
+    def read(self, address, count):
+        reply = self.request(struct.pack('>BHH', 3, address, count), 5 + 2 * count)
+        return list(struct.unpack('>%dH' % count, reply[3:3 + 2 * count]))
+
+    def write(self, address, value):
+        self.request(struct.pack('>BHH', 6, address, value), 8)
+
+def read_board(port, slave, baud, keep):
+    bus = ModbusRTU(port, slave, baud)
+    bus.write(TRACE_ADDRESS + TRACE_CONTROL, TRACE_STOP)
+    try:
+        header = bus.read(TRACE_ADDRESS, TRACE_DATA)
+        total = TRACE_DATA + 4 * header[TRACE_NUM_ENTRIES]
+        regs = list(header)
+        while len(regs) < total:
+            count = min(MAX_READ, total - len(regs))
+            regs += bus.read(TRACE_ADDRESS + len(regs), count)
+    finally:
+        bus.write(TRACE_ADDRESS + TRACE_CONTROL, 0 if keep else TRACE_CLEAR)
+    return regs
+
+def read_file(path):
+    with open(path) as f:
+        return [int(v, 0) for v in f.read().split()]
+
+# Entries from the oldest, as (cycles, event, argument), the 32 bit DWT time unwrapped.
+# The slots never written have event 0.
+def entries(regs):
+    count = regs[TRACE_NUM_ENTRIES]
+    result = []
+    last = None
+    offset = 0
+    for i in range(count):
+        base = TRACE_DATA + 4 * ((regs[TRACE_HEAD] + i) % count)
+        if regs[base + 2] == 0:
+            continue
+        t = (regs[base] << 16) | regs[base + 1]
+        if last is not None and t < last:
+            offset += 1 << 32
+        last = t
+        result.append((t + offset, regs[base + 2], regs[base + 3]))
+    return result
+
+def describe(event, arg):
+    name = EVENTS.get(event, 'event %d' % event)
+    if event == 1:
+        return '%s %s' % (name, MB_EVENTS.get(arg, arg))
+    if event == 5:
+        return '%s %s' % (name, 'failed' if arg else 'ok')
+    return '%s %d' % (name, arg)
+
+def print_timeline(regs):
+    mhz = float(regs[TRACE_CLOCK_MHZ] or 72)
+    events = entries(regs)
+    print('%d events recorded, %d in the ring' % (regs[TRACE_COUNT], len(events)))
+    if not events:
+        return
+    start = events[0][0]
+    previous = start
+    open_spans = {}
+    print('%12s %10s  %s' % ('time us', 'delta us', 'event'))
+    for t, event, arg in events:
+        line = '%12.1f %10.1f  %s' % ((t - start) / mhz, (t - previous) / mhz, describe(event, arg))
+        if event in SPANS.values():
+            open_spans[(event, arg if event == 6 else None)] = t
+        elif event in SPANS:
+            begin = open_spans.pop((SPANS[event], arg if event == 7 else None), None)
+            if begin is not None:
+                line += '  (%.1f us)' % ((t - begin) / mhz)
+        print(line)
+        previous = t
+
+def main():
+    args = sys.argv[1:]
+    slave, baud, save, keep = 8, 19200, None, False
+    source = None
+    while args:
+        a = args.pop(0)
+        if a == '--slave':
+            slave = int(args.pop(0))
+        elif a == '--baud':
+            baud = int(args.pop(0))
+        elif a == '--save':
+            save = args.pop(0)
+        elif a == '--keep':
+            keep = True
+        else:
+            source = a
+    if source is None:
+        print('Usage: python decode_trace.py PORT|FILE [--slave N] [--baud N] [--save FILE] [--keep]')
+        sys.exit(2)
+
+    if os.path.isfile(source):
+        regs = read_file(source)
+    else:
+        regs = read_board(source, slave, baud, keep)
+    if save:
+        with open(save, 'w') as f:
+            f.write('\n'.join(str(v) for v in regs) + '\n')
+    print_timeline(regs)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,90 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * The few places where the acquisition loop touches the hardware directly.
+ * On the board these are the same register accesses as before, with no cost.
+ * Built with HAL_SIM (treceri/sim, CMake) they go to the virtual MCP3903,
+ * 23K256, zero-cross input and USART of the Linux simulator.
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+#ifdef HAL_SIM
+#include "hal_sim.h"
+#else
+
+// Zero-cross input PB11 and MCP3903 /DRA on PA2
+#define HAL_ZERO_CROSS_HIGH   ((GPIOB->IDR & GPIO_Pin_11) != 0)
+#define HAL_DRA_HIGH          ((GPIOA->IDR & GPIO_Pin_2) != 0)
+
+// DWT cycle counter registers
+#define HAL_DWT_CONTROL       0xE0001000
+#define HAL_DWT_CYCCNT        0xE0001004
+#define HAL_SCB_DEMCR         0xE000EDFC
+
+// Called in the busy waits for an interrupt, the simulator advances its time here
+#define HAL_IDLE()
+
+// Code run from SRAM when RAMFUNC_ENABLE is defined (treceri.coproj), for the
+// short integer functions that call nothing else (SPISend, the zero-cross
+// interrupt): their own instructions do not wait for the flash (2 wait states
+// at 72 MHz). Not for the float code, it runs in the soft-float helpers of
+// libgcc, which stay in the flash. It takes its size in RAM. The .ramfunc
+// section is in .data (arm-gcc-link.ld), copied at reset; long_call, the SRAM
+// is too far from the flash for a BL. The gain is not measured yet.
+#ifdef RAMFUNC_ENABLE
+#define HAL_RAMFUNC           __attribute__((section(".ramfunc"), long_call, noinline))
+#else
+#define HAL_RAMFUNC
+#endif
+
+// Last 1 KB page of the 64 KB flash of the C8, for the phase calibration. It is
+// kept out of the program: IROM1 (and rom in arm-gcc-link.ld) ends at 0x0800FC00
+#define HAL_CAL_PAGE          0x0800FC00
+#define HAL_CAL_DATA          ((const uint16_t *)HAL_CAL_PAGE)
+
+// Memory map, from the linker script and the stack of startup_stm32f10x_md.c
+// (STACK_SIZE words)
+extern unsigned long _sidata, _sdata, _edata, _sbss, _ebss, _sramfunc, _eramfunc;
+extern unsigned long pulStack[];
+#define HAL_RAM_SIZE          (20 * 1024)
+#define HAL_FLASH_START       0x08004000  // IROM1, after the bootloader
+#define HAL_FLASH_SIZE        0xBC00      // IROM1, without the calibration page
+#define HAL_STACK_BOTTOM      ((uint32_t *)pulStack)
+#define HAL_STACK_SIZE        (0x200 * 4)
+#define HAL_DATA_SIZE         ((uint8_t *)&_edata - (uint8_t *)&_sdata)
+#define HAL_BSS_SIZE          ((uint8_t *)&_ebss - (uint8_t *)&_sbss)
+#define HAL_RAMFUNC_SIZE      ((uint8_t *)&_eramfunc - (uint8_t *)&_sramfunc)
+#define HAL_FLASH_USED        ((uint8_t *)&_sidata - (uint8_t *)HAL_FLASH_START + HAL_DATA_SIZE)
+
+#endif
+
+// Systick, GPIO, TIM2 (ADC clock) and the zero-cross input
+void Board_Init(void);
+// EXTI11 interrupt on the zero-cross input, after eMBInit( )
+void ZeroCross_Init(void);
+// SPI1 to the MCP3903 and the 23K256
+void SPI_init(void);
+HAL_RAMFUNC uint8_t SPISend(uint8_t data);
+// Erase the calibration page and write count half words, 0 = OK
+int Flash_WriteCalPage(const uint16_t *data, uint16_t count);
+
+#endif
@@ -0,0 +1,201 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include <math.h>
+#include "history.h"
+#include "sysmon.h"
+
+// Sums of the window for one channel
+typedef struct {
+    int32_t rms_sum;
+    int64_t rms_squares;
+    int32_t phase_sum;       // Of the differences from phase_ref
+    int64_t phase_squares;
+    uint16_t phase_ref;      // Phase * 100
+} history_sums_t;
+
+static history_sums_t history_sums[6];
+static uint16_t history_skipped;  // Published results since the last one kept
+
+static u16 *history_entry(uint16_t index) {
+    return &usRegHistoryBuf[HISTORY_DATA + HISTORY_ENTRY_REGS * index];
+}
+
+// a - b of two phases * 100, -18000..17999
+static int32_t history_phase_diff(uint16_t a, uint16_t b) {
+    int32_t d = ((int32_t)a - (int32_t)b) % 36000;
+
+    if (d >= 18000) d -= 36000;
+    if (d < -18000) d += 36000;
+    return d;
+}
+
+// Nearest integer of num / den, den > 0
+static int32_t history_div(int64_t num, int32_t den) {
+    return (int32_t)((num >= 0 ? num + den / 2 : num - den / 2) / den);
+}
+
+// Standard deviation from the sums of n values, rounded, limited to 65535
+static uint16_t history_std(int32_t sum, int64_t squares, uint16_t n) {
+    int64_t v = (int64_t)n * squares - (int64_t)sum * sum;  // n^2 * variance, exact
+    double std;
+
+    if (v <= 0)
+        return 0;
+    std = sqrt((double)v) / n + 0.5;
+    return (std > 65535.0) ? 65535 : (uint16_t)std;
+}
+
+// change per span_ms as per minute, signed, limited to +-32767
+static uint16_t history_rate(int32_t change, uint32_t span_ms) {
+    int32_t rate;
+
+    if (span_ms == 0)
+        return 0;
+    rate = history_div((int64_t)change * 60000, (int32_t)span_ms);
+    if (rate > 32767) rate = 32767;
+    if (rate < -32767) rate = -32767;
+    return (uint16_t)(int16_t)rate;
+}
+
+static uint32_t history_time(const u16 *entry) {
+    return ((uint32_t)entry[HISTORY_ENTRY_TIME] << 16) | entry[HISTORY_ENTRY_TIME + 1];
+}
+
+// Add (sign 1) or remove (sign -1) an entry from the sums
+static void history_sum(const u16 *entry, int32_t sign) {
+    history_sums_t *s;
+    int32_t rms, phase;
+    uint8_t ch;
+
+    for (ch = 0; ch < 6; ch++) {
+        s = &history_sums[ch];
+        rms = entry[HISTORY_ENTRY_RMS + ch];
+        phase = history_phase_diff(entry[HISTORY_ENTRY_PHASE + ch], s->phase_ref);
+        s->rms_sum += sign * rms;
+        s->rms_squares += sign * (int64_t)rms * rms;
+        s->phase_sum += sign * phase;
+        s->phase_squares += sign * (int64_t)phase * phase;
+    }
+}
+
+// Sums of the whole window again from the phases of its oldest entry, so the
+// phase differences stay small while the phases drift
+static void history_rebase(void) {
+    uint16_t used = usRegHistoryBuf[HISTORY_USED];
+    uint16_t first = (usRegHistoryBuf[HISTORY_HEAD] - used) & (HISTORY_ENTRIES - 1);
+    uint16_t i;
+    uint8_t ch;
+
+    for (ch = 0; ch < 6; ch++) {
+        history_sums[ch].rms_sum = 0;
+        history_sums[ch].rms_squares = 0;
+        history_sums[ch].phase_sum = 0;
+        history_sums[ch].phase_squares = 0;
+        history_sums[ch].phase_ref = history_entry(first)[HISTORY_ENTRY_PHASE + ch];
+    }
+    for (i = 0; i < used; i++)
+        history_sum(history_entry((first + i) & (HISTORY_ENTRIES - 1)), 1);
+}
+
+static void history_publish(void) {
+    uint16_t used = usRegHistoryBuf[HISTORY_USED];
+    const u16 *oldest = history_entry((usRegHistoryBuf[HISTORY_HEAD] - used) & (HISTORY_ENTRIES - 1));
+    const u16 *newest = history_entry((usRegHistoryBuf[HISTORY_HEAD] - 1) & (HISTORY_ENTRIES - 1));
+    uint32_t span_ms = history_time(newest) - history_time(oldest);
+    history_sums_t *s;
+    u16 *stat;
+    int32_t phase;
+    uint8_t ch;
+
+    for (ch = 0; ch < 6; ch++) {
+        s = &history_sums[ch];
+        stat = &usRegHistoryBuf[HISTORY_STATS + HISTORY_STAT_REGS * ch];
+        stat[HISTORY_STAT_RMS_MEAN] = (uint16_t)history_div(s->rms_sum, used);
+        stat[HISTORY_STAT_RMS_STD] = history_std(s->rms_sum, s->rms_squares, used);
+        stat[HISTORY_STAT_RMS_RATE] = history_rate((int32_t)newest[HISTORY_ENTRY_RMS + ch] -
+                                                   (int32_t)oldest[HISTORY_ENTRY_RMS + ch], span_ms);
+        phase = (s->phase_ref + history_div(s->phase_sum, used) + 36000) % 36000;
+        stat[HISTORY_STAT_PHASE_MEAN] = (uint16_t)phase;
+        stat[HISTORY_STAT_PHASE_STD] = history_std(s->phase_sum, s->phase_squares, used);
+        stat[HISTORY_STAT_PHASE_RATE] = history_rate(history_phase_diff(newest[HISTORY_ENTRY_PHASE + ch],
+                                                                        oldest[HISTORY_ENTRY_PHASE + ch]), span_ms);
+    }
+}
+
+static void history_clear(void) {
+    uint16_t i;
+
+    for (i = HISTORY_HEAD; i < HISTORY_NREGS; i++)
+        usRegHistoryBuf[i] = 0;
+    usRegHistoryBuf[HISTORY_NUM_ENTRIES] = HISTORY_ENTRIES;
+    for (i = 0; i < 6; i++) {
+        history_sums[i].rms_sum = 0;
+        history_sums[i].rms_squares = 0;
+        history_sums[i].phase_sum = 0;
+        history_sums[i].phase_squares = 0;
+        history_sums[i].phase_ref = 0;
+    }
+    history_skipped = 0;
+}
+
+void History_Init(void) {
+    usRegHistoryBuf[HISTORY_CONTROL] = 0;
+    usRegHistoryBuf[HISTORY_DECIMATION] = HISTORY_DECIMATION_DEFAULT;
+    history_clear();
+}
+
+void History_Add(uint16_t capture_seq) {
+    uint16_t head = usRegHistoryBuf[HISTORY_HEAD];
+    u16 *entry = history_entry(head);
+    uint32_t now = SysMonMillis;
+    uint8_t i;
+
+    if (usRegHistoryBuf[HISTORY_DECIMATION] == 0 ||
+        ++history_skipped < usRegHistoryBuf[HISTORY_DECIMATION])
+        return;
+    history_skipped = 0;
+
+    // The oldest entry leaves the window when the ring is full
+    if (usRegHistoryBuf[HISTORY_USED] == HISTORY_ENTRIES)
+        history_sum(entry, -1);
+
+    entry[HISTORY_ENTRY_TIME] = now >> 16;
+    entry[HISTORY_ENTRY_TIME + 1] = now & 0xFFFF;
+    entry[HISTORY_ENTRY_SEQ] = capture_seq;
+    for (i = 0; i < 12; i++)
+        entry[HISTORY_ENTRY_RMS + i] = readHoldingRegister(1 + i);
+
+    usRegHistoryBuf[HISTORY_HEAD] = (head + 1) & (HISTORY_ENTRIES - 1);
+    usRegHistoryBuf[HISTORY_COUNT]++;
+    if (usRegHistoryBuf[HISTORY_USED] < HISTORY_ENTRIES)
+        usRegHistoryBuf[HISTORY_USED]++;
+
+    // New reference phases for the first entry and at each turn of the ring
+    if (usRegHistoryBuf[HISTORY_USED] == 1 || usRegHistoryBuf[HISTORY_HEAD] == 0)
+        history_rebase();
+    else
+        history_sum(entry, 1);
+    history_publish();
+}
+
+void History_Poll(void) {
+    if (usRegHistoryBuf[HISTORY_CONTROL] & HISTORY_CLEAR) {
+        usRegHistoryBuf[HISTORY_CONTROL] &= ~HISTORY_CLEAR;
+        history_clear();
+    }
+}
@@ -0,0 +1,53 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Result history: a ring of the last HISTORY_ENTRIES published results, with
+ * the time since reset and the capture sequence, and the trend of each channel
+ * over that window, readable at REG_HISTORY_START. The master can poll once
+ * per window instead of once per capture and still see every result.
+ *
+ * An entry is the phasor of each channel as published in the holding
+ * registers: RMS voltage * 10000 (1..6) and phase * 100 (7..12).
+ *
+ * The statistics are kept up to date per entry: the sums of the values and of
+ * their squares get the new entry and lose the one it overwrites. The phases
+ * are summed as the difference (-180..180 degrees) from the oldest phase of
+ * the window, taken again at each turn of the ring, so a channel near 0 / 360
+ * degrees has the right mean and a slow drift does not wrap. The rate is the
+ * change from the oldest to the newest entry, per minute.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include "main.h"
+
+// Bits of HISTORY_CONTROL
+#define HISTORY_CLEAR        0x0001  // Empty the ring and the statistics, reads back 0
+
+#define HISTORY_DECIMATION_DEFAULT  1  // Every published result
+
+// Empty ring, every result kept
+void History_Init(void);
+// Add the results just written to the holding registers, once per publish
+void History_Add(uint16_t capture_seq);
+// HISTORY_CONTROL written by the master, from the main loop
+void History_Poll(void);
+
+#endif
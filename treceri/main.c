@@ -102,300 +102,19 @@
 #include "stm32f10x.h"
 #include "math.h"
 #include "main.h"
+#include "hal.h"
+#include "calibration.h"
+#include "profiler.h"
+#include "sysmon.h"
+#include "trace.h"
+#include "history.h"
+#include "dsp_core.h"
 #include "mbutils.h"
 #include "mb.h"
 
-// Flattop Window: If the purpose of the test focus more on the energy value of a
-// certain periodic signal frequency point. For example for Upeak, Upeak-peak, Urms,
-// then the accuracy of its amplitude is more important, and a window with slighty
-// wider lobes is better.
-// The Flat Top window has a flatter passband, which helps retain accurate amplitude
-// and phase information, particularly when analyzing signals where frequency peaks
-// must be well-isolated. Since the window decreases the leakage, the phase extraction
-// becomes more accurate. However, keep in mind that this window broadens the peaks,
-// so you might sacrifice some resolution in the frequency domain.
-/*void generate_flat_top_window(float *window, size_t num_points) {
-    // Flat Top window coefficients
-    const float a0 = 1.0;
-    const float a1 = 1.93;
-    const float a2 = 1.29;
-    const float a3 = 0.388;
-    const float a4 = 0.028;
-
-    for (size_t n = 0; n < num_points; n++) {
-        // Compute the normalized index value
-        float factor = (2 * PI * n) / (num_points - 1);
-
-        // Apply the Flat Top window function
-        window[n] = a0
-                  - a1 * cos(factor)
-                  + a2 * cos(2 * factor)
-                  - a3 * cos(3 * factor)
-                  + a4 * cos(4 * factor);
-    }
-}
-*/
-const float flattop_window[] = {
-0.000000, -0.000001, -0.000004, -0.000008, -0.000014, -0.000022, -0.000032, -0.000043,
--0.000056, -0.000071, -0.000088, -0.000106, -0.000127, -0.000149, -0.000173, -0.000198,
--0.000226, -0.000255, -0.000286, -0.000319, -0.000354, -0.000390, -0.000429, -0.000469,
--0.000511, -0.000556, -0.000602, -0.000650, -0.000700, -0.000751, -0.000805, -0.000861,
--0.000919, -0.000978, -0.001040, -0.001104, -0.001170, -0.001238, -0.001308, -0.001380,
--0.001454, -0.001530, -0.001609, -0.001690, -0.001773, -0.001858, -0.001945, -0.002035,
--0.002127, -0.002221, -0.002317, -0.002416, -0.002517, -0.002621, -0.002727, -0.002836,
--0.002947, -0.003060, -0.003176, -0.003295, -0.003416, -0.003539, -0.003666, -0.003795,
--0.003926, -0.004061, -0.004198, -0.004338, -0.004480, -0.004626, -0.004774, -0.004926,
--0.005080, -0.005237, -0.005397, -0.005560, -0.005726, -0.005896, -0.006068, -0.006243,
--0.006422, -0.006604, -0.006789, -0.006977, -0.007169, -0.007364, -0.007562, -0.007764,
--0.007969, -0.008178, -0.008390, -0.008606, -0.008826, -0.009048, -0.009275, -0.009505,
--0.009740, -0.009977, -0.010219, -0.010465, -0.010714, -0.010967, -0.011224, -0.011486,
--0.011751, -0.012020, -0.012294, -0.012571, -0.012853, -0.013139, -0.013429, -0.013724,
--0.014022, -0.014326, -0.014633, -0.014945, -0.015262, -0.015583, -0.015908, -0.016239,
--0.016574, -0.016913, -0.017257, -0.017606, -0.017960, -0.018319, -0.018683, -0.019051,
--0.019424, -0.019803, -0.020186, -0.020575, -0.020968, -0.021367, -0.021771, -0.022180,
--0.022594, -0.023014, -0.023439, -0.023869, -0.024305, -0.024746, -0.025193, -0.025645,
--0.026103, -0.026567, -0.027036, -0.027510, -0.027991, -0.028477, -0.028968, -0.029466,
--0.029970, -0.030479, -0.030994, -0.031515, -0.032042, -0.032576, -0.033115, -0.033660,
--0.034212, -0.034769, -0.035333, -0.035903, -0.036479, -0.037061, -0.037650, -0.038245,
--0.038846, -0.039454, -0.040068, -0.040688, -0.041315, -0.041949, -0.042589, -0.043235,
--0.043888, -0.044548, -0.045215, -0.045887, -0.046567, -0.047253, -0.047946, -0.048646,
--0.049353, -0.050066, -0.050786, -0.051513, -0.052247, -0.052987, -0.053735, -0.054489,
--0.055250, -0.056018, -0.056794, -0.057576, -0.058365, -0.059161, -0.059964, -0.060774,
--0.061591, -0.062415, -0.063246, -0.064084, -0.064929, -0.065781, -0.066640, -0.067507,
--0.068380, -0.069261, -0.070148, -0.071043, -0.071945, -0.072854, -0.073770, -0.074693,
--0.075623, -0.076560, -0.077504, -0.078456, -0.079414, -0.080380, -0.081352, -0.082332,
--0.083319, -0.084312, -0.085313, -0.086321, -0.087336, -0.088357, -0.089386, -0.090422,
--0.091464, -0.092514, -0.093570, -0.094634, -0.095704, -0.096781, -0.097865, -0.098956,
--0.100053, -0.101157, -0.102268, -0.103386, -0.104510, -0.105641, -0.106779, -0.107923,
--0.109073, -0.110230, -0.111394, -0.112564, -0.113740, -0.114923, -0.116112, -0.117308,
--0.118509, -0.119717, -0.120931, -0.122151, -0.123377, -0.124609, -0.125847, -0.127090,
--0.128340, -0.129595, -0.130857, -0.132123, -0.133396, -0.134674, -0.135957, -0.137246,
--0.138541, -0.139840, -0.141145, -0.142455, -0.143770, -0.145090, -0.146415, -0.147745,
--0.149080, -0.150419, -0.151763, -0.153112, -0.154465, -0.155823, -0.157185, -0.158551,
--0.159922, -0.161296, -0.162675, -0.164057, -0.165443, -0.166833, -0.168227, -0.169624,
--0.171024, -0.172428, -0.173835, -0.175246, -0.176659, -0.178075, -0.179494, -0.180916,
--0.182341, -0.183767, -0.185197, -0.186628, -0.188062, -0.189498, -0.190936, -0.192375,
--0.193817, -0.195259, -0.196704, -0.198149, -0.199596, -0.201044, -0.202493, -0.203943,
--0.205393, -0.206844, -0.208295, -0.209747, -0.211199, -0.212651, -0.214102, -0.215554,
--0.217005, -0.218455, -0.219905, -0.221354, -0.222802, -0.224248, -0.225694, -0.227138,
--0.228580, -0.230020, -0.231459, -0.232895, -0.234330, -0.235762, -0.237191, -0.238617,
--0.240041, -0.241461, -0.242879, -0.244292, -0.245703, -0.247109, -0.248512, -0.249910,
--0.251304, -0.252694, -0.254078, -0.255459, -0.256834, -0.258203, -0.259568, -0.260927,
--0.262280, -0.263627, -0.264967, -0.266302, -0.267630, -0.268951, -0.270265, -0.271572,
--0.272872, -0.274164, -0.275449, -0.276725, -0.277993, -0.279253, -0.280504, -0.281747,
--0.282980, -0.284204, -0.285419, -0.286624, -0.287819, -0.289004, -0.290179, -0.291343,
--0.292497, -0.293639, -0.294771, -0.295891, -0.296999, -0.298095, -0.299179, -0.300251,
--0.301311, -0.302357, -0.303391, -0.304411, -0.305417, -0.306410, -0.307389, -0.308354,
--0.309304, -0.310240, -0.311160, -0.312065, -0.312955, -0.313830, -0.314688, -0.315530,
--0.316356, -0.317165, -0.317957, -0.318732, -0.319489, -0.320229, -0.320951, -0.321654,
--0.322340, -0.323006, -0.323654, -0.324282, -0.324891, -0.325480, -0.326049, -0.326598,
--0.327126, -0.327634, -0.328120, -0.328585, -0.329029, -0.329451, -0.329850, -0.330228,
--0.330582, -0.330914, -0.331222, -0.331508, -0.331769, -0.332006, -0.332219, -0.332408,
--0.332572, -0.332710, -0.332824, -0.332912, -0.332973, -0.333009, -0.333018, -0.333001,
--0.332957, -0.332885, -0.332786, -0.332659, -0.332504, -0.332320, -0.332108, -0.331867,
--0.331597, -0.331297, -0.330968, -0.330608, -0.330218, -0.329798, -0.329347, -0.328865,
--0.328351, -0.327806, -0.327228, -0.326619, -0.325977, -0.325302, -0.324594, -0.323853,
--0.323078, -0.322270, -0.321427, -0.320549, -0.319637, -0.318690, -0.317708, -0.316690,
--0.315637, -0.314547, -0.313421, -0.312259, -0.311059, -0.309822, -0.308548, -0.307236,
--0.305887, -0.304499, -0.303072, -0.301607, -0.300102, -0.298559, -0.296975, -0.295352,
--0.293689, -0.291985, -0.290241, -0.288456, -0.286630, -0.284762, -0.282853, -0.280901,
--0.278908, -0.276872, -0.274793, -0.272672, -0.270507, -0.268299, -0.266047, -0.263751,
--0.261411, -0.259026, -0.256597, -0.254123, -0.251603, -0.249038, -0.246428, -0.243771,
--0.241069, -0.238320, -0.235524, -0.232682, -0.229792, -0.226855, -0.223871, -0.220839,
--0.217758, -0.214630, -0.211453, -0.208227, -0.204953, -0.201629, -0.198256, -0.194834,
--0.191361, -0.187839, -0.184267, -0.180644, -0.176970, -0.173246, -0.169471, -0.165645,
--0.161767, -0.157837, -0.153856, -0.149823, -0.145737, -0.141600, -0.137409, -0.133166,
--0.128870, -0.124521, -0.120119, -0.115663, -0.111153, -0.106590, -0.101973, -0.097302,
--0.092576, -0.087796, -0.082961, -0.078072, -0.073127, -0.068128, -0.063073, -0.057963,
--0.052797, -0.047576, -0.042299, -0.036966, -0.031577, -0.026132, -0.020630, -0.015072,
--0.009458, -0.003786, 0.001942, 0.007727, 0.013569, 0.019468, 0.025424, 0.031438,
-0.037510, 0.043638, 0.049825, 0.056069, 0.062371, 0.068731, 0.075149, 0.081625,
-0.088159, 0.094752, 0.101402, 0.108111, 0.114879, 0.121705, 0.128589, 0.135532,
-0.142534, 0.149595, 0.156714, 0.163892, 0.171129, 0.178425, 0.185779, 0.193193,
-0.200665, 0.208197, 0.215787, 0.223436, 0.231145, 0.238912, 0.246739, 0.254624,
-0.262569, 0.270572, 0.278635, 0.286756, 0.294937, 0.303176, 0.311475, 0.319832,
-0.328248, 0.336723, 0.345257, 0.353850, 0.362501, 0.371211, 0.379980, 0.388807,
-0.397692, 0.406636, 0.415639, 0.424699, 0.433818, 0.442995, 0.452230, 0.461523,
-0.470875, 0.480283, 0.489750, 0.499273, 0.508855, 0.518494, 0.528190, 0.537943,
-0.547754, 0.557621, 0.567545, 0.577525, 0.587562, 0.597655, 0.607805, 0.618011,
-0.628272, 0.638590, 0.648962, 0.659391, 0.669875, 0.680413, 0.691007, 0.701656,
-0.712358, 0.723115, 0.733927, 0.744793, 0.755712, 0.766684, 0.777710, 0.788790,
-0.799922, 0.811107, 0.822344, 0.833634, 0.844976, 0.856369, 0.867814, 0.879311,
-0.890859, 0.902457, 0.914105, 0.925805, 0.937555, 0.949353, 0.961202, 0.973100,
-0.985047, 0.997042, 1.009086, 1.021178, 1.033318, 1.045505, 1.057739, 1.070021,
-1.082349, 1.094723, 1.107143, 1.119610, 1.132121, 1.144677, 1.157277, 1.169923,
-1.182612, 1.195345, 1.208121, 1.220940, 1.233802, 1.246705, 1.259651, 1.272639,
-1.285667, 1.298735, 1.311845, 1.324995, 1.338184, 1.351411, 1.364678, 1.377985,
-1.391328, 1.404709, 1.418127, 1.431583, 1.445074, 1.458601, 1.472164, 1.485763,
-1.499395, 1.513062, 1.526763, 1.540498, 1.554265, 1.568065, 1.581897, 1.595761,
-1.609656, 1.623581, 1.637536, 1.651522, 1.665537, 1.679580, 1.693652, 1.707752,
-1.721879, 1.736033, 1.750213, 1.764421, 1.778652, 1.792909, 1.807190, 1.821496,
-1.835824, 1.850176, 1.864549, 1.878946, 1.893363, 1.907801, 1.922259, 1.936739,
-1.951236, 1.965752, 1.980287, 1.994840, 2.009409, 2.023995, 2.038597, 2.053216,
-2.067848, 2.082494, 2.097155, 2.111830, 2.126517, 2.141216, 2.155927, 2.170649,
-2.185381, 2.200124, 2.214875, 2.229636, 2.244405, 2.259180, 2.273963, 2.288754,
-2.303549, 2.318350, 2.333155, 2.347965, 2.362778, 2.377594, 2.392412, 2.407233,
-2.422054, 2.436875, 2.451696, 2.466518, 2.481338, 2.496155, 2.510970, 2.525782,
-2.540590, 2.555394, 2.570192, 2.584986, 2.599773, 2.614553, 2.629325, 2.644091,
-2.658846, 2.673593, 2.688329, 2.703056, 2.717770, 2.732473, 2.747163, 2.761841,
-2.776504, 2.791153, 2.805787, 2.820406, 2.835008, 2.849594, 2.864161, 2.878711,
-2.893242, 2.907753, 2.922244, 2.936715, 2.951164, 2.965591, 2.979995, 2.994377,
-3.008734, 3.023066, 3.037373, 3.051656, 3.065910, 3.080138, 3.094338, 3.108510,
-3.122652, 3.136765, 3.150847, 3.164900, 3.178919, 3.192907, 3.206861, 3.220783,
-3.234670, 3.248522, 3.262338, 3.276120, 3.289863, 3.303570, 3.317238, 3.330869,
-3.344459, 3.358010, 3.371520, 3.384990, 3.398417, 3.411801, 3.425143, 3.438442,
-3.451695, 3.464904, 3.478067, 3.491185, 3.504256, 3.517278, 3.530253, 3.543180,
-3.556057, 3.568884, 3.581661, 3.594387, 3.607061, 3.619683, 3.632251, 3.644767,
-3.657228, 3.669635, 3.681986, 3.694282, 3.706520, 3.718702, 3.730826, 3.742892,
-3.754899, 3.766846, 3.778733, 3.790561, 3.802327, 3.814030, 3.825672, 3.837251,
-3.848767, 3.860218, 3.871604, 3.882927, 3.894182, 3.905372, 3.916495, 3.927551,
-3.938539, 3.949458, 3.960308, 3.971089, 3.981800, 3.992440, 4.003008, 4.013506,
-4.023932, 4.034284, 4.044563, 4.054770, 4.064901, 4.074957, 4.084939, 4.094845,
-4.104675, 4.114428, 4.124104, 4.133702, 4.143222, 4.152663, 4.162025, 4.171308,
-4.180511, 4.189632, 4.198673, 4.207633, 4.216511, 4.225306, 4.234018, 4.242648,
-4.251194, 4.259655, 4.268032, 4.276325, 4.284532, 4.292652, 4.300687, 4.308636,
-4.316496, 4.324270, 4.331956, 4.339554, 4.347063, 4.354483, 4.361814, 4.369055,
-4.376205, 4.383266, 4.390235, 4.397114, 4.403901, 4.410596, 4.417198, 4.423709,
-4.430126, 4.436450, 4.442680, 4.448817, 4.454859, 4.460807, 4.466660, 4.472418,
-4.478080, 4.483647, 4.489118, 4.494492, 4.499770, 4.504951, 4.510035, 4.515021,
-4.519910, 4.524701, 4.529394, 4.533989, 4.538485, 4.542882, 4.547180, 4.551379,
-4.555478, 4.559477, 4.563377, 4.567176, 4.570876, 4.574474, 4.577972, 4.581369,
-4.584665, 4.587860, 4.590952, 4.593945, 4.596834, 4.599622, 4.602308, 4.604892,
-4.607374, 4.609753, 4.612030, 4.614204, 4.616275, 4.618243, 4.620108, 4.621871,
-4.623529, 4.625085, 4.626538, 4.627887, 4.629132, 4.630274, 4.631312, 4.632247,
-4.633078, 4.633805, 4.634429, 4.634948, 4.635364, 4.635675, 4.635883, 4.635987,
-4.635987, 4.635883, 4.635675, 4.635364, 4.634948, 4.634429, 4.633805, 4.633078,
-4.632247, 4.631312, 4.630274, 4.629132, 4.627887, 4.626538, 4.625085, 4.623529,
-4.621871, 4.620108, 4.618243, 4.616275, 4.614203, 4.612030, 4.609753, 4.607374,
-4.604892, 4.602308, 4.599622, 4.596834, 4.593944, 4.590953, 4.587860, 4.584665,
-4.581369, 4.577972, 4.574474, 4.570876, 4.567176, 4.563377, 4.559477, 4.555478,
-4.551379, 4.547180, 4.542882, 4.538485, 4.533989, 4.529394, 4.524702, 4.519910,
-4.515021, 4.510035, 4.504951, 4.499770, 4.494492, 4.489118, 4.483647, 4.478080,
-4.472417, 4.466660, 4.460807, 4.454859, 4.448817, 4.442680, 4.436450, 4.430126,
-4.423708, 4.417199, 4.410596, 4.403901, 4.397114, 4.390235, 4.383266, 4.376206,
-4.369054, 4.361814, 4.354483, 4.347063, 4.339553, 4.331956, 4.324270, 4.316497,
-4.308635, 4.300687, 4.292653, 4.284532, 4.276324, 4.268033, 4.259655, 4.251194,
-4.242648, 4.234019, 4.225306, 4.216511, 4.207633, 4.198673, 4.189632, 4.180511,
-4.171308, 4.162025, 4.152663, 4.143222, 4.133701, 4.124104, 4.114428, 4.104675,
-4.094845, 4.084939, 4.074958, 4.064901, 4.054769, 4.044563, 4.034284, 4.023932,
-4.013506, 4.003009, 3.992440, 3.981800, 3.971088, 3.960308, 3.949458, 3.938539,
-3.927550, 3.916495, 3.905372, 3.894183, 3.882926, 3.871605, 3.860218, 3.848767,
-3.837251, 3.825672, 3.814031, 3.802327, 3.790560, 3.778734, 3.766846, 3.754899,
-3.742892, 3.730826, 3.718702, 3.706521, 3.694281, 3.681986, 3.669635, 3.657229,
-3.644767, 3.632252, 3.619683, 3.607061, 3.594387, 3.581661, 3.568885, 3.556057,
-3.543180, 3.530253, 3.517278, 3.504256, 3.491184, 3.478067, 3.464904, 3.451696,
-3.438441, 3.425143, 3.411801, 3.398417, 3.384989, 3.371520, 3.358010, 3.344459,
-3.330868, 3.317238, 3.303570, 3.289864, 3.276119, 3.262339, 3.248522, 3.234670,
-3.220782, 3.206861, 3.192907, 3.178920, 3.164899, 3.150847, 3.136765, 3.122653,
-3.108509, 3.094338, 3.080138, 3.065911, 3.051655, 3.037374, 3.023066, 3.008734,
-2.994376, 2.979995, 2.965591, 2.951164, 2.936714, 2.922244, 2.907753, 2.893242,
-2.878711, 2.864161, 2.849594, 2.835009, 2.820406, 2.805787, 2.791153, 2.776505,
-2.761840, 2.747163, 2.732473, 2.717771, 2.703055, 2.688329, 2.673593, 2.658847,
-2.644090, 2.629326, 2.614553, 2.599773, 2.584985, 2.570193, 2.555394, 2.540591,
-2.525782, 2.510970, 2.496155, 2.481338, 2.466517, 2.451697, 2.436876, 2.422054,
-2.407232, 2.392412, 2.377594, 2.362779, 2.347965, 2.333155, 2.318350, 2.303550,
-2.288753, 2.273964, 2.259181, 2.244405, 2.229635, 2.214875, 2.200124, 2.185382,
-2.170649, 2.155927, 2.141216, 2.126518, 2.111830, 2.097156, 2.082495, 2.067848,
-2.053215, 2.038597, 2.023995, 2.009409, 1.994839, 1.980287, 1.965753, 1.951236,
-1.936738, 1.922260, 1.907802, 1.893364, 1.878945, 1.864550, 1.850176, 1.835825,
-1.821495, 1.807190, 1.792909, 1.778653, 1.764420, 1.750214, 1.736033, 1.721879,
-1.707752, 1.693652, 1.679580, 1.665537, 1.651523, 1.637537, 1.623580, 1.609655,
-1.595760, 1.581897, 1.568065, 1.554266, 1.540499, 1.526765, 1.513062, 1.499395,
-1.485762, 1.472164, 1.458601, 1.445074, 1.431583, 1.418128, 1.404708, 1.391327,
-1.377984, 1.364679, 1.351412, 1.338184, 1.324995, 1.311846, 1.298735, 1.285666,
-1.272638, 1.259651, 1.246706, 1.233802, 1.220941, 1.208122, 1.195344, 1.182611,
-1.169923, 1.157278, 1.144677, 1.132121, 1.119610, 1.107144, 1.094723, 1.082348,
-1.070021, 1.057740, 1.045505, 1.033318, 1.021179, 1.009087, 0.997041, 0.985046,
-0.973100, 0.961202, 0.949354, 0.937555, 0.925806, 0.914107, 0.902456, 0.890858,
-0.879311, 0.867814, 0.856369, 0.844976, 0.833635, 0.822345, 0.811106, 0.799921,
-0.788789, 0.777710, 0.766684, 0.755712, 0.744793, 0.733928, 0.723115, 0.712358,
-0.701655, 0.691007, 0.680413, 0.669875, 0.659391, 0.648963, 0.638589, 0.628272,
-0.618010, 0.607805, 0.597656, 0.587562, 0.577526, 0.567545, 0.557620, 0.547753,
-0.537943, 0.528190, 0.518494, 0.508855, 0.499274, 0.489750, 0.480283, 0.470874,
-0.461523, 0.452230, 0.442995, 0.433819, 0.424700, 0.415639, 0.406636, 0.397692,
-0.388806, 0.379979, 0.371211, 0.362501, 0.353850, 0.345258, 0.336723, 0.328248,
-0.319832, 0.311475, 0.303177, 0.294937, 0.286757, 0.278636, 0.270572, 0.262569,
-0.254624, 0.246739, 0.238912, 0.231145, 0.223437, 0.215788, 0.208196, 0.200665,
-0.193193, 0.185779, 0.178425, 0.171129, 0.163892, 0.156715, 0.149594, 0.142534,
-0.135532, 0.128589, 0.121705, 0.114879, 0.108112, 0.101403, 0.094751, 0.088159,
-0.081625, 0.075149, 0.068731, 0.062371, 0.056069, 0.049825, 0.043638, 0.037509,
-0.031438, 0.025424, 0.019468, 0.013569, 0.007727, 0.001942, -0.003787, -0.009458,
--0.015072, -0.020630, -0.026132, -0.031577, -0.036966, -0.042299, -0.047576, -0.052798,
--0.057963, -0.063073, -0.068128, -0.073127, -0.078071, -0.082961, -0.087796, -0.092576,
--0.097302, -0.101973, -0.106590, -0.111153, -0.115663, -0.120118, -0.124521, -0.128870,
--0.133166, -0.137409, -0.141599, -0.145737, -0.149822, -0.153856, -0.157837, -0.161767,
--0.165645, -0.169471, -0.173246, -0.176970, -0.180644, -0.184266, -0.187839, -0.191362,
--0.194834, -0.198256, -0.201629, -0.204953, -0.208227, -0.211453, -0.214630, -0.217759,
--0.220839, -0.223871, -0.226855, -0.229792, -0.232682, -0.235524, -0.238320, -0.241069,
--0.243771, -0.246428, -0.249038, -0.251603, -0.254123, -0.256597, -0.259026, -0.261411,
--0.263751, -0.266047, -0.268299, -0.270507, -0.272672, -0.274793, -0.276872, -0.278908,
--0.280901, -0.282853, -0.284762, -0.286630, -0.288456, -0.290241, -0.291985, -0.293689,
--0.295352, -0.296975, -0.298559, -0.300102, -0.301607, -0.303072, -0.304499, -0.305887,
--0.307236, -0.308548, -0.309822, -0.311059, -0.312258, -0.313421, -0.314547, -0.315637,
--0.316690, -0.317708, -0.318690, -0.319637, -0.320549, -0.321427, -0.322270, -0.323078,
--0.323853, -0.324594, -0.325302, -0.325977, -0.326619, -0.327228, -0.327806, -0.328351,
--0.328865, -0.329347, -0.329798, -0.330218, -0.330608, -0.330968, -0.331297, -0.331597,
--0.331867, -0.332108, -0.332320, -0.332504, -0.332659, -0.332786, -0.332885, -0.332957,
--0.333001, -0.333018, -0.333009, -0.332973, -0.332912, -0.332824, -0.332710, -0.332572,
--0.332408, -0.332219, -0.332006, -0.331769, -0.331508, -0.331222, -0.330914, -0.330582,
--0.330228, -0.329850, -0.329451, -0.329029, -0.328585, -0.328120, -0.327634, -0.327126,
--0.326598, -0.326049, -0.325480, -0.324891, -0.324282, -0.323654, -0.323006, -0.322340,
--0.321654, -0.320951, -0.320229, -0.319489, -0.318732, -0.317957, -0.317165, -0.316356,
--0.315530, -0.314688, -0.313830, -0.312955, -0.312066, -0.311160, -0.310239, -0.309304,
--0.308354, -0.307389, -0.306410, -0.305417, -0.304411, -0.303391, -0.302357, -0.301311,
--0.300251, -0.299179, -0.298095, -0.296999, -0.295891, -0.294771, -0.293639, -0.292497,
--0.291343, -0.290179, -0.289004, -0.287819, -0.286624, -0.285419, -0.284204, -0.282980,
--0.281747, -0.280504, -0.279253, -0.277993, -0.276725, -0.275449, -0.274164, -0.272872,
--0.271572, -0.270265, -0.268951, -0.267630, -0.266302, -0.264968, -0.263626, -0.262279,
--0.260927, -0.259568, -0.258203, -0.256834, -0.255459, -0.254079, -0.252693, -0.251304,
--0.249910, -0.248512, -0.247109, -0.245703, -0.244292, -0.242879, -0.241461, -0.240041,
--0.238617, -0.237191, -0.235762, -0.234330, -0.232896, -0.231459, -0.230020, -0.228580,
--0.227138, -0.225694, -0.224248, -0.222802, -0.221354, -0.219905, -0.218455, -0.217005,
--0.215554, -0.214102, -0.212651, -0.211199, -0.209747, -0.208295, -0.206844, -0.205393,
--0.203943, -0.202493, -0.201044, -0.199596, -0.198149, -0.196704, -0.195259, -0.193816,
--0.192375, -0.190936, -0.189498, -0.188062, -0.186628, -0.185197, -0.183767, -0.182340,
--0.180916, -0.179494, -0.178075, -0.176659, -0.175246, -0.173835, -0.172428, -0.171024,
--0.169624, -0.168227, -0.166833, -0.165443, -0.164057, -0.162675, -0.161296, -0.159922,
--0.158551, -0.157185, -0.155823, -0.154465, -0.153112, -0.151763, -0.150419, -0.149080,
--0.147745, -0.146415, -0.145090, -0.143770, -0.142455, -0.141145, -0.139840, -0.138540,
--0.137246, -0.135957, -0.134674, -0.133396, -0.132124, -0.130857, -0.129595, -0.128340,
--0.127090, -0.125847, -0.124609, -0.123377, -0.122151, -0.120931, -0.119717, -0.118509,
--0.117308, -0.116112, -0.114923, -0.113740, -0.112564, -0.111394, -0.110230, -0.109073,
--0.107923, -0.106779, -0.105641, -0.104510, -0.103386, -0.102268, -0.101157, -0.100053,
--0.098956, -0.097865, -0.096781, -0.095704, -0.094634, -0.093571, -0.092514, -0.091464,
--0.090422, -0.089386, -0.088357, -0.087336, -0.086321, -0.085313, -0.084312, -0.083319,
--0.082332, -0.081352, -0.080380, -0.079414, -0.078456, -0.077504, -0.076560, -0.075623,
--0.074693, -0.073770, -0.072854, -0.071945, -0.071043, -0.070148, -0.069261, -0.068380,
--0.067507, -0.066640, -0.065781, -0.064929, -0.064084, -0.063246, -0.062415, -0.061591,
--0.060774, -0.059964, -0.059161, -0.058365, -0.057576, -0.056794, -0.056018, -0.055250,
--0.054489, -0.053735, -0.052987, -0.052247, -0.051513, -0.050786, -0.050066, -0.049353,
--0.048646, -0.047946, -0.047253, -0.046567, -0.045888, -0.045215, -0.044548, -0.043888,
--0.043235, -0.042589, -0.041949, -0.041315, -0.040688, -0.040068, -0.039454, -0.038846,
--0.038245, -0.037650, -0.037061, -0.036479, -0.035903, -0.035333, -0.034769, -0.034211,
--0.033660, -0.033115, -0.032576, -0.032042, -0.031515, -0.030994, -0.030479, -0.029970,
--0.029466, -0.028968, -0.028477, -0.027991, -0.027510, -0.027036, -0.026567, -0.026103,
--0.025645, -0.025193, -0.024746, -0.024305, -0.023870, -0.023439, -0.023014, -0.022594,
--0.022180, -0.021771, -0.021367, -0.020968, -0.020575, -0.020186, -0.019803, -0.019424,
--0.019051, -0.018683, -0.018319, -0.017960, -0.017606, -0.017257, -0.016913, -0.016574,
--0.016239, -0.015908, -0.015583, -0.015262, -0.014945, -0.014633, -0.014326, -0.014022,
--0.013723, -0.013429, -0.013139, -0.012853, -0.012571, -0.012294, -0.012020, -0.011751,
--0.011486, -0.011224, -0.010967, -0.010714, -0.010465, -0.010219, -0.009977, -0.009740,
--0.009505, -0.009275, -0.009048, -0.008826, -0.008606, -0.008390, -0.008178, -0.007969,
--0.007764, -0.007562, -0.007364, -0.007169, -0.006977, -0.006789, -0.006604, -0.006422,
--0.006243, -0.006068, -0.005896, -0.005726, -0.005560, -0.005397, -0.005237, -0.005080,
--0.004926, -0.004774, -0.004626, -0.004480, -0.004338, -0.004198, -0.004061, -0.003926,
--0.003795, -0.003666, -0.003539, -0.003416, -0.003295, -0.003176, -0.003060, -0.002947,
--0.002836, -0.002727, -0.002621, -0.002517, -0.002416, -0.002317, -0.002221, -0.002126,
--0.002035, -0.001945, -0.001858, -0.001773, -0.001690, -0.001609, -0.001530, -0.001454,
--0.001380, -0.001308, -0.001238, -0.001170, -0.001104, -0.001040, -0.000978, -0.000919,
--0.000861, -0.000805, -0.000751, -0.000700, -0.000650, -0.000602, -0.000556, -0.000511,
--0.000469, -0.000429, -0.000390, -0.000354, -0.000319, -0.000286, -0.000255, -0.000226,
--0.000198, -0.000173, -0.000149, -0.000127, -0.000106, -0.000088, -0.000071, -0.000056,
--0.000043, -0.000032, -0.000022, -0.000014, -0.000008, -0.000004, -0.000001, 0.000000
-};
-
-// FFT buffer
-float xyData[4096];
+// FFT buffer, the 2048 samples of one channel and then its packed FFT
+// (real_fft_packed), half of the Re, Im buffer real_fft() needs
+float xyData[2048];
 
 // Min and max of the leakage current signals
 float minCH0 = 1000.0;
@@ -438,13 +157,26 @@ float phaseCH5 = 0;
 #define MCP3903_CS_low    GPIO_ResetBits(GPIOA, SS)
 #define MCP3903_CS_high   GPIO_SetBits(GPIOA, SS)
 
+// Busy wait while cond is true, at most timeout_ms (TickCount, 1 ms resolution).
+// wait_timeout is 1 after it when the time ran out.
+#define WAIT_WHILE(cond, timeout_ms) \
+    for (wait_start = TickCount, wait_timeout = 0; \
+         (cond) && !(wait_timeout = (TickCount - wait_start > (timeout_ms))); )
+
+#define ZC_TIMEOUT_MS     100   // 5 mains periods without a zero-cross edge
+#define DRA_TIMEOUT_MS    2     // The MCP3903 gives a sample every 85 us
+#define CAPTURE_MAX_MS    200   // 2048 samples are 175 ms, a longer capture is counted as slow
+
 // Zero cross signal input pin
-#define WaitHiSIG   while ((GPIOB->IDR & GPIO_Pin_11) == 0)
-#define WaitLoSIG   while ((GPIOB->IDR & GPIO_Pin_11) != 0)
+#define WaitHiSIG   WAIT_WHILE(!HAL_ZERO_CROSS_HIGH, ZC_TIMEOUT_MS)
+#define WaitLoSIG   WAIT_WHILE(HAL_ZERO_CROSS_HIGH, ZC_TIMEOUT_MS)
 
 // ADC dataready pin
-#define WaitHiDRA   while ((GPIOA->IDR & GPIO_Pin_2) == 0)
-#define WaitLoDRA   while ((GPIOA->IDR & GPIO_Pin_2) != 0)
+#define WaitHiDRA   WAIT_WHILE(!HAL_DRA_HIGH, DRA_TIMEOUT_MS)
+#define WaitLoDRA   WAIT_WHILE(HAL_DRA_HIGH, DRA_TIMEOUT_MS)
+
+uint32_t wait_start;
+uint8_t wait_timeout;
 
 // Bytes for ADC values (2 bytes each 16 bit value)
 uint8_t MSB0, LSB0;
@@ -454,18 +186,34 @@ uint8_t MSB3, LSB3;
 uint8_t MSB4, LSB4;
 uint8_t MSB5, LSB5;
 
-// Counter for the 4096 samples of the signal
+// Counter for the 2048 samples of the signal
 uint16_t sample_counter;
 
 // Phase shift counter in nanoseconds between zerocross and the actual
 // ADC start to acquire data, based on /DRA pin of the ADC
 volatile uint32_t CPUTicks;
+// DWT count where CPUTicks starts, the counter itself runs free for the profiler
+uint32_t capture_start;
+
+// Zero-cross impulses counted by the EXTI11 interrupt, and the DWT ticks of the last one
+volatile uint32_t ZeroCrossCount;
+volatile uint32_t ZeroCrossDWT;
+// ZeroCrossCount at the end of the last received frame (Modbus T3.5 timer)
+volatile uint32_t FrameZeroCross;
+// FrameZeroCross of the frame that wrote REG_SYNC_ARM
+uint32_t SyncArmZeroCross;
+
+// Synchronized capture armed, its target zero-cross and sequence numbers
+uint8_t sync_capture = 0;
+uint32_t sync_target;
+uint16_t sync_seq;
+uint16_t capture_seq = 0;  // Sequence of the data in SRAM, 0 = free running capture
 
 uint8_t flag = 0;
 
 // Functions definition for the SPI pheripheral and the ADC
 void SPI_init(void);
-uint8_t SPISend(uint8_t data);
+HAL_RAMFUNC uint8_t SPISend(uint8_t data);
 void MCP3903_init(void);
 
 // SRAM Hold line override
@@ -502,12 +250,14 @@ void MCP3903_init(void);
 
 // Volatile counter updated in Systick interrupt
 volatile uint32_t TimingDelay;
+// Milliseconds since reset, updated in Systick interrupt
+volatile uint32_t TickCount;
 
 void Delay(volatile uint32_t nTime)
 {
     TimingDelay = nTime;
 
-    while(TimingDelay != 0);
+    while(TimingDelay != 0) HAL_IDLE();
 }
 
 // Flag to to know when the Modbus data sending has complete
@@ -515,6 +265,18 @@ volatile uint8_t Modbus_End_Transmission_Flag;
 
 // Modbus dataspace
 u16 usRegHoldingBuf[40+1];  // 0..40 Holding registers
+u16 usRegSpectrumBuf[SPECTRUM_NREGS];  // Spectrum window, see main.h
+u16 usRegProfileBuf[PROFILE_NREGS];  // Cycle profiler, see main.h
+u16 usRegHealthBuf[HEALTH_NREGS];  // Health counters, see main.h
+u16 usRegSystemBuf[SYSTEM_NREGS];  // System monitor, see main.h
+u16 usRegTraceBuf[TRACE_NREGS];  // Event trace, see main.h
+u16 usRegHistoryBuf[HISTORY_NREGS];  // Result history, see main.h
+
+// + 1 on a health counter, it stays at 0xFFFF
+void countHealth(uint8_t index) {
+    if (usRegHealthBuf[index] < 0xFFFF)
+        usRegHealthBuf[index]++;
+}
 u8  usRegCoilBuf[64/8+1];  // 0..64  Coils
 
 void writeCoil (uint8_t coil_index, uint8_t state) {
@@ -539,9 +301,9 @@ uint16_t readHoldingRegister (uint8_t reg_index) {
 }
 
 // DWT pheriperal registers
-volatile uint32_t *DWT_CONTROL = (volatile uint32_t *)0xE0001000;
-volatile uint32_t *DWT_CYCCNT  = (volatile uint32_t *)0xE0001004;
-volatile uint32_t *SCB_DEMCR   = (volatile uint32_t *)0xE000EDFC;
+volatile uint32_t *DWT_CONTROL = (volatile uint32_t *)HAL_DWT_CONTROL;
+volatile uint32_t *DWT_CYCCNT  = (volatile uint32_t *)HAL_DWT_CYCCNT;
+volatile uint32_t *SCB_DEMCR   = (volatile uint32_t *)HAL_SCB_DEMCR;
 
 void DWT_Enable (void) {
     // Enable the use of DWT
@@ -552,56 +314,6 @@ void DWT_Enable (void) {
     *DWT_CONTROL = *DWT_CONTROL | 1;
 }
 
-#define PI        3.1415926535897932384626433832795
-#define DEG2RAD   0.01745329251994329576923690768489
-#define RAD2DEG   57.295779513082320876798154814105  // 180/PI
-#define EPSILON   1e-8 // Small value for zero comparison
-
-// Calculates the FFT phase at a given frequency index.
-// Input: data is complex FFT Re[V(0)],Im[V(0)], Re[V(1)],Im[V(1)],...
-// Input: nn is the number of points in the data and in the FFT,
-//           nn must be a power of 2
-// Input: k is frequency index 0 to nn/2-1
-//        E.g., if nn = 4096, then k can be 0 to 2047
-// Output: Phase at this frequency
-// data is an array of 2*nn elements
-// returns 0 if k >= nn/2
-float myfftPhase (float data[], unsigned long nn, uint16_t k) {
-    if (k >= nn / 2) {
-        return 0.0; // out of range
-    }
-
-    // Extract the real and imaginary parts of the k-th element
-    float real_part = data[2 * k];
-    float imag_part = data[2 * k + 1];
-
-    // Handle the case when both real and imaginary parts are zero (undefined phase)
-    if (fabs(real_part) < EPSILON && fabs(imag_part) < EPSILON) {
-        return 0.0; // phase is undefined
-    }
-
-    // Calculate the angle in radians using atan2
-    float angle_rad = atan2(imag_part, real_part);
-
-    // Convert the angle to degrees
-    float angle_deg = angle_rad * RAD2DEG;
-
-    angle_deg += 137.1126;
-    
-    if (angle_deg < 0.0) {
-        angle_deg += 360.0;
-    }
-    
-    return angle_deg;
-}
-
-// Apply the Flat Top window to the signal
-void apply_flattop_window(float *signal, const float *flattop_window, size_t num_points) {
-    for (size_t n = 0; n < num_points; n++) {
-        signal[n * 2] = signal[n * 2] * flattop_window[n]; // Apply the window to the real part
-    }
-}
-
 // Load to xyData buffer the selected signal from the SRAM memory
 void load_Channel_To_FFTbuffer (uint8_t channel) {
     uint16_t i;
@@ -613,7 +325,7 @@ void load_Channel_To_FFTbuffer (uint8_t channel) {
     SPISend(0x00);  // LSB
 
     i = 0;
-    while (i < 4096) {
+    while (i < 2048) {
         // Read all 6 channels at once from SRAM
         MSB0 = SPISend(0xFF); LSB0 = SPISend(0xFF);
         MSB1 = SPISend(0xFF); LSB1 = SPISend(0xFF);
@@ -653,11 +365,9 @@ void load_Channel_To_FFTbuffer (uint8_t channel) {
                 break;
         }
 
-        // Data is from 2 in 2, Re,Im, Re,Im,...
+        // Samples one after the other, there is no imaginary side for real_fft_packed()
         // Convert 16 bit ADC values to actual voltage
-        xyData[i] = ((float)((int16_t)((MSB0 << 8) | LSB0)) / 32767.0 / 3.0) * 2.39;  // ADC Vref = 2.39V
-        // The imaginary side is zero when we load the real signal
-        xyData[i + 1] = 0;
+        xyData[i] = adc_code_to_voltage((int16_t)((MSB0 << 8) | LSB0));  // ADC Vref = 2.39V
 
         // Each time we load a channel to FFT buffer, we also find the MIN and MAX
         // and update the global variables
@@ -691,247 +401,122 @@ void load_Channel_To_FFTbuffer (uint8_t channel) {
                 break;
         }
 
-        i += 2;
+        i++;
     }
     DISABLE_RAM;
 }
 
-// Helper macro to swap two float values
-#define SWAP(a, b) { float temp = (a); (a) = (b); (b) = temp; }
-
-// FFT optimized for a signal array only with real side values, no imaginary
-// Input: nn is the number of points in the data and in the FFT (must be a power of 2).
-// Input: data is an array of nn real elements (no imaginary part initially, from ADC)
-//        Re(0),0,Re(1),0,Re(2),...Re(nn-1),0
-// Output: data will be transformed to contain complex FFT coefficients where the real
-//         and imaginary parts are interleaved in the same array (Re, Im, Re, Im...).
-void real_fft (float data[], unsigned long nn) {
-    unsigned long n, mmax, m, j, istep, i;
-    double wtemp, wr, wpr, wpi, wi, theta;
-    double tempr, tempi;
-
-    // `nn` is the number of real samples. In the complex FFT,
-    // `n` will be twice `nn` because each complex number has two parts (Re and Im).
-    n = nn << 1;  // n = 2 * nn, for real + imaginary storage (even though input is real, output will be complex)
-
-    // ---- Bit-reversal Reordering ----
-    // The FFT requires the input to be in bit-reversed order to optimize
-    // in-place computation. Here we rearrange the data in such order.
-    j = 1;
-    for (i = 1; i < n; i += 2) {
-        if (j > i) {  // Swap only if j > i to avoid swapping elements back
-            SWAP(data[j-1], data[i-1]);  // Swap the real part
-            SWAP(data[j], data[i]);      // Swap the imaginary part (initially 0)
-        }
-
-        // Bit-reversal logic (this shifts the bits around in a specific way
-        // to reorder the data).
-        m = n >> 1;
-        while (m >= 2 && j > m) {
-            j -= m;
-            m >>= 1;
-        }
-        j += m;
+// Copy a window of raw samples of one channel from the SRAM straight into `dest`.
+// The values are 16 bit ADC codes, MSB first, exactly as the MCP3903 gave them,
+// which is also the Modbus register byte order, so the Modbus RTU buffer can be
+// passed as `dest` and no copy is made in xyData.
+// Each sample is addressed separately (5 SPI bytes), instead of streaming all
+// 6 channels (12 SPI bytes) and dropping the other 5.
+void read_Channel_From_SRAM (uint8_t channel, uint16_t first_sample, uint16_t num_samples, uint8_t *dest) {
+    uint16_t address;
+
+    while (num_samples--) {
+        // We jump 12 by 12 bytes (6 x 16 bit values), plus the channel offset
+        address = first_sample * 12 + channel * 2;
+
+        ENABLE_RAM;
+        SPISend(READ);
+        SPISend((char)(address >> 8));  // MSB
+        SPISend((char)address);  // LSB
+        *dest++ = SPISend(0xFF);
+        *dest++ = SPISend(0xFF);
+        DISABLE_RAM;
+
+        first_sample++;
     }
+}
 
-    // ---- Danielson-Lanczos Recursion ----
-    // This is the heart of the FFT algorithm, where the computation is performed
-    // in a recursive, divide-and-conquer manner.
-    mmax = 2;  // mmax starts at 2 (which means we first handle 2-element blocks)
-    while (n > mmax) {
-        istep = mmax << 1;  // Step size for each FFT recursion level (block size)
-
-        // Calculate the angle (theta) for the trigonometric recurrence relation
-        // that is used to compute the FFT (twiddle factors).
-        theta = -2.0 * PI / mmax;
-        wtemp = sin(0.5 * theta);
-        wpr = -2.0 * wtemp * wtemp;  // Real part of twiddle factor
-        wpi = sin(theta);            // Imaginary part of twiddle factor
-        wr = 1.0;                    // Starting value for twiddle real part (cos(0) = 1)
-        wi = 0.0;                    // Starting value for twiddle imaginary part (sin(0) = 0)
-
-        // For each recursion level, we loop through the data in chunks
-        // of size `mmax`, computing the FFT step for each pair of elements.
-        for (m = 1; m < mmax; m += 2) {
-            for (i = m; i <= n; i += istep) {
-                // The FFT is performed in pairs of elements. We compute the
-                // real and imaginary parts of these elements and apply the twiddle factors.
-                j = i + mmax;  // This is the other element in the pair
-
-                // Calculate the real and imaginary components of the twiddle factor for this step
-                tempr = wr * data[j-1] - wi * data[j];
-                tempi = wr * data[j] + wi * data[j-1];
-
-                // Update the real and imaginary parts with the calculated values
-                data[j-1] = data[i-1] - tempr;
-                data[j]   = data[i]   - tempi;
-                data[i-1] = data[i-1] + tempr;
-                data[i]   = data[i]   + tempi;
+// Cache magnitude (and phase) of the configured bin range while xyData still
+// holds the FFT of this channel. The window is read over Modbus, so the values
+// stay the same for a whole cycle.
+// Magnitude: RMS voltage * 10000 of the component (the Flat Top window has a
+//            coherent gain of 1, the bin amplitude is 2 * |X(k)| / nn)
+// Phase:     raw FFT phase * 100, 0..35999, from the first sample (no offset)
+// If the channel was below the threshold there is no FFT, all values are 0.
+// Bin 0 is real, its slot in the packed FFT has the real Nyquist bin as Im.
+void update_Spectrum_Cache (uint8_t channel, uint8_t fft_valid) {
+    uint16_t first_bin, num_bins, i;
+    uint32_t k, last_bin;
+    float re, im, magnitude, phase;
+
+    if (channel != usRegSpectrumBuf[SPECTRUM_CHANNEL])
+        return;
+
+    first_bin = usRegSpectrumBuf[SPECTRUM_FIRST_BIN];
+    num_bins = usRegSpectrumBuf[SPECTRUM_NUM_BINS];
+    if (num_bins > SPECTRUM_MAX_BINS)
+        num_bins = SPECTRUM_MAX_BINS;
+    // port.c rejects a bad window, this keeps the loop in the buffer anyway
+    if (first_bin > 1023)
+        first_bin = 1023;
+    last_bin = (uint32_t)first_bin + num_bins;
+    if (last_bin > 1024)
+        last_bin = 1024;
+
+    i = SPECTRUM_DATA;
+    for (k = first_bin; k < last_bin && i < SPECTRUM_NREGS; k++) {
+        magnitude = 0.0;
+        phase = 0.0;
+
+        if (fft_valid) {
+            re = xyData[2 * k];
+            im = k ? xyData[2 * k + 1] : 0.0;
+            // 2 / 2048 for the amplitude, / sqrt(2) for RMS
+            magnitude = sqrt(re * re + im * im) * (1.41421356 / 2048.0);
+            if (fabs(re) > EPSILON || fabs(im) > EPSILON) {
+                phase = atan2(im, re) * RAD2DEG;
+                if (phase < 0.0)
+                    phase += 360.0;
             }
-
-            // Update the twiddle factors for the next iteration. This is done
-            // using the recurrence relation for trigonometric functions.
-            wtemp = wr;
-            wr = wr * wpr - wi * wpi + wr;
-            wi = wi * wpr + wtemp * wpi + wi;
         }
 
-        // Double the block size for the next level of recursion.
-        mmax = istep;
+        magnitude *= 10000.0;
+        usRegSpectrumBuf[i++] = (magnitude > 65535.0) ? 65535 : (uint16_t)magnitude;
+        if ((usRegSpectrumBuf[SPECTRUM_FLAGS] & SPECTRUM_FLAG_PHASE) && i < SPECTRUM_NREGS)
+            usRegSpectrumBuf[i++] = (uint16_t)(phase * 100.0);
     }
-}
-
-// Adjust the phase to be an integer with `2 decimals` ( * 100)
-uint16_t adjust_phase(float phase, float phase_difference) {
-    // If phase difference it to big something is broken
-    if (phase_difference >= 359.0)  // THE DWT TICKS COUNTER HAS GONE WHILD ON US !!! :)
-        return 0;
-
-    // Subtract the small delay from the moment we had zero-cross impulse
-    // till the moment the ADC had first data ready (/DRA high)
-    float adjusted_phase = phase - phase_difference;
 
-    // Ensure the result is in the range [0, 360)
-    if (adjusted_phase < 0) {
-        adjusted_phase += 360.0;
-    }
-
-    // Scale by 100 and return as an integer. We keep two decimals of precision
-    return (uint16_t)(adjusted_phase * 100.0);
-}
-
-// Adjust the voltage so that we have current only in 0..100 mA
-uint16_t adjust_voltage (float voltage) {
-    uint16_t voltage_value = 0;
-
-    // Prevent negative values
-    if (voltage < 0)
-        return 0;
-
-    // Scale by 10000 and convert to integer
-    // The ADC `sees` voltage up to 0.6V without degraded precision
-    voltage_value = (uint16_t)(voltage * 10000.0);
-
-    // Top voltage at 100 mA (0.1 A * 5.6 OHM = 0.56 V * 10000.0 = 5600)
-    if (voltage_value > 5600)
-        return 5600;
-
-    return voltage_value;
+    // Clear what is left from a previous, larger window
+    while (i < SPECTRUM_NREGS)
+        usRegSpectrumBuf[i++] = 0;
 }
 
 int main (void) {
-    GPIO_InitTypeDef GPIO_InitStructure;
-    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
-    TIM_OCInitTypeDef TIM_OCInitStructure;
-
     uint8_t step_counter;  // State machine counter
+    uint8_t capture_failed = 0;  // No zero-cross or no /DRA, the cycle starts again
+    uint8_t i;
+    uint32_t capture_tick = 0;
+    uint32_t last_zero_cross;
+    uint8_t run_step;  // Run the current step in this loop
+    uint8_t autonomous_cycle = 0;  // The steps of this cycle do not wait for Modbus
+    uint32_t cycle_start = 0;  // TickCount at the last capture
+    uint16_t meas_period;
 
     // --->>> Vectors position was set in system_stm32f10x.c, line 128
     // Set the Vector Table base adress at 0x8004000
     // NVIC_SetVectorTable(NVIC_VectTab_FLASH, 0x4000);
 
     /************************************************************
-    *   Enable Systick interrupt at 1 ms
+    *   Paint the free stack for its high-water mark, before
+    *   any interrupt runs, and the memory map registers
     *************************************************************/
-    if (SysTick_Config(72000)) {  // 1 ms interrupt 72 MHz / 72000 = 1000
-        // Capture error
-        while (1);
-    }
+    SysMon_Init();
 
     /************************************************************
-    *   Enable the use of internal DWT for counting
+    *   Systick, relays, LED, side switching, /DRA and zero-cross
+    *   inputs, TIM2 clock of the ADC (see Board_Init)
     *************************************************************/
-    DWT_Enable();
-
-    /************************************************************
-    *   Init B6,B7,B8,B9,B12,B13,B14,B15 relays
-    *************************************************************/
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB , ENABLE);
-    GPIO_StructInit(&GPIO_InitStructure);
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_15 | GPIO_Pin_14 | GPIO_Pin_13 | GPIO_Pin_12 | GPIO_Pin_9 | GPIO_Pin_8 | GPIO_Pin_7 | GPIO_Pin_6;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
-    GPIO_Init(GPIOB, &GPIO_InitStructure);
-
-    /************************************************************
-    *   All relays OFF
-    *************************************************************/
-    GPIOB->BSRR = GPIO_Pin_15 |GPIO_Pin_14 |GPIO_Pin_13 | GPIO_Pin_12 |GPIO_Pin_9 |GPIO_Pin_8 | GPIO_Pin_7 | GPIO_Pin_6;
-
-    /************************************************************
-    *   Init led PC13 (BluePill LED)
-    *************************************************************/
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC , ENABLE);
-    GPIO_StructInit(&GPIO_InitStructure);
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_13;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
-    GPIO_Init(GPIOC, &GPIO_InitStructure);
-
-    /************************************************************
-    *   Init PB0 & PB1 side switching (A,B,C / a, b, c)
-    *************************************************************/
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB , ENABLE);
-    GPIO_StructInit(&GPIO_InitStructure);
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1 | GPIO_Pin_0;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
-    GPIO_Init(GPIOB, &GPIO_InitStructure);
-    // Set pins to LOW
-    GPIOB->BRR = GPIO_Pin_1 |GPIO_Pin_0;
-
-    /************************************************************
-    *   Init PA2 as input floating to get /DRA channel
-    *************************************************************/
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA , ENABLE);
-    GPIO_StructInit(&GPIO_InitStructure);
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_2;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_Init(GPIOA, &GPIO_InitStructure);
-
-    /************************************************************
-    *   Start TIM2_CH2 on pin PA1 at 3 MHz, 50 % duty
-    *   as clock for MCP3903 ADC
-    *************************************************************/
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA | RCC_APB2Periph_AFIO, ENABLE);
-    GPIO_StructInit(&GPIO_InitStructure);
-    GPIO_InitStructure.GPIO_Pin =  GPIO_Pin_1;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
-    GPIO_Init( GPIOA, &GPIO_InitStructure );
-
-    /************************************************************
-    *   TIM2 clock enable
-    *************************************************************/
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2 , ENABLE);
-    TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
-    TIM_TimeBaseStructure.TIM_Prescaler = 12 - 1;  // 72 MHz / 12 = 6 MHz
-    TIM_TimeBaseStructure.TIM_Period = 2 - 1;  // 6 MHz / 2 = 3 MHz  / 256 = 11718.75
-    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
-    TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
-    TIM_TimeBaseInit(TIM2, &TIM_TimeBaseStructure);
-
-    TIM_OCStructInit(&TIM_OCInitStructure);
-    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
-    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
-    TIM_OCInitStructure.TIM_Pulse = 0;
-    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
-    TIM_OC2Init(TIM2, &TIM_OCInitStructure);  // Channel 2 configuration = PA1
-
-    TIM_ARRPreloadConfig(TIM2, ENABLE);
-    TIM_CtrlPWMOutputs(TIM2, ENABLE);
-    TIM_Cmd(TIM2, ENABLE);
-    TIM2->CCR2 = 1;
+    Board_Init();
 
     /************************************************************
-    *   Init PB11 as input floating to get zero-cross impulse
+    *   Enable the use of internal DWT for counting
     *************************************************************/
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB , ENABLE);
-    GPIO_InitStructure.GPIO_Pin =  GPIO_Pin_11;
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
-    GPIO_Init(GPIOB, &GPIO_InitStructure);
+    DWT_Enable();
 
     /************************************************************
     *   Full SWJ Disabled (JTAG-DP + SW-DP)
@@ -969,16 +554,114 @@ int main (void) {
     // Enable the Modbus Protocol Stack.
     eMBEnable();
 
+    /************************************************************
+    *   EXTI11 on PB11 rising edge, counts the zero-cross impulses
+    *   (after eMBInit, the NVIC priority group is set there)
+    *************************************************************/
+    ZeroCross_Init();
+
+    // Default delay for the synchronized capture
+    writeHoldingRegister(REG_SYNC_DELAY, SYNC_DELAY_DEFAULT);
+
+    // Phase offsets of this board, from the flash
+    Cal_Init();
+
+    // Stage cycle counts, read by the master at 300..
+    Prof_Init();
+
+    // Event trace, read by the master at 600..
+    Trace_Init();
+
+    // Result history and trends, read by the master at 900..
+    History_Init();
+
+    // Default spectrum window, CH0 magnitude for the first 60 bins (5.7 .. 343 Hz)
+    usRegSpectrumBuf[SPECTRUM_CHANNEL] = 0;
+    usRegSpectrumBuf[SPECTRUM_FIRST_BIN] = 1;
+    usRegSpectrumBuf[SPECTRUM_NUM_BINS] = SPECTRUM_MAX_BINS;
+    usRegSpectrumBuf[SPECTRUM_FLAGS] = 0;
+
     step_counter = 0;
 
     TimingDelay = 0;
 
     while (1) {
+        // Only polling until a reply or a step makes the loop busy
+        SYSMON_IDLE();
+        // Nothing on the board, the simulator runs its peripherals here
+        HAL_IDLE();
+
         Modbus_End_Transmission_Flag = 0;
+        Prof_Begin(PROF_MODBUS);
         eMBPoll();
+        Prof_End(PROF_MODBUS);
+
+        // Modbus event queue statistics
+        writeHoldingRegister(REG_EVENT_OVERFLOWS, usMBPortEventOverflows);
+        writeHoldingRegister(REG_EVENT_HIGH_WATER, usMBPortEventHighWater);
+
+        // Health counters of the Modbus port, the master writes 1 to clear them all
+        if (usRegHealthBuf[HEALTH_CONTROL] != 0) {
+            for (i = 0; i < HEALTH_NREGS; i++)
+                usRegHealthBuf[i] = 0;
+            usMBPortUARTOverruns = 0;
+            usMBRTUCRCErrors = 0;
+            usMBRTURxOverflows = 0;
+        }
+        usRegHealthBuf[HEALTH_UART_OVERRUNS] = usMBPortUARTOverruns;
+        usRegHealthBuf[HEALTH_CRC_ERRORS] = usMBRTUCRCErrors;
+        usRegHealthBuf[HEALTH_RX_OVERFLOWS] = usMBRTURxOverflows;
+
+        // Synchronized capture, armed by writing a sequence number to REG_SYNC_ARM.
+        // The master broadcasts it, all boards got the frame at the same time and
+        // count the same zero-crosses from its end, so they capture the same cycle.
+        // A broadcast has no reply, so the scheduler starts the cycle and we drop the current one.
+        if (readHoldingRegister(REG_SYNC_ARM) != 0) {
+            sync_seq = readHoldingRegister(REG_SYNC_ARM);
+            writeHoldingRegister(REG_SYNC_ARM, 0);
+            sync_target = SyncArmZeroCross + readHoldingRegister(REG_SYNC_DELAY);
+            sync_capture = 1;
+            step_counter = 0;
+        }
+
+        // Phase calibration commands (REG_CAL_COMMAND)
+        Cal_Poll();
+        // Profiler reset (PROFILE_CONTROL)
+        Prof_Poll();
+        // CPU load and stack high-water mark
+        SysMon_Poll();
+        // Trace stop, clear and mask (TRACE_CONTROL, TRACE_MASK)
+        Trace_Poll();
+        // History clear (HISTORY_CONTROL)
+        History_Poll();
+
+        // Measurement scheduler
+        // REG_MEAS_PERIOD = 0: one step after each Modbus reply (3 replies for a cycle)
+        // REG_MEAS_PERIOD > 0: a new cycle every REG_MEAS_PERIOD ms, the 3 steps run
+        //                      one after another, with a Modbus poll between them
+        // A write to REG_MEAS_TRIGGER, or an armed synchronized capture, starts a
+        // cycle right now in both modes.
+        meas_period = readHoldingRegister(REG_MEAS_PERIOD);
+        run_step = 0;
+        if (step_counter == 0) {
+            if (sync_capture || readHoldingRegister(REG_MEAS_TRIGGER) != 0 ||
+                (meas_period != 0 && (uint32_t)(TickCount - cycle_start) >= meas_period)) {
+                writeHoldingRegister(REG_MEAS_TRIGGER, 0);
+                autonomous_cycle = 1;
+                run_step = 1;
+            } else if (meas_period == 0 && Modbus_End_Transmission_Flag == 1) {
+                autonomous_cycle = 0;
+                run_step = 1;
+            }
+            if (run_step)
+                cycle_start = TickCount;
+        } else {
+            run_step = autonomous_cycle || Modbus_End_Transmission_Flag;
+        }
 
         // Everything happends right after modbus ended the transmission of data
         if (Modbus_End_Transmission_Flag == 1) {
+            SYSMON_BUSY();
             // Update relays state on each modbus interogation
             // B12  -  K1
             // B9   -  K2
@@ -1028,15 +711,48 @@ int main (void) {
                 Delay(100);
                 GPIOB->BRR = GPIO_Pin_1;
             }
+        }
 
+        if (run_step == 1) {
+            SYSMON_BUSY();
+            Trace(TRACE_STEP, step_counter);
             // STEP 0 ==== load data to SRAM
             if (step_counter == 0) {
                 // Toggle LED
                 GPIOC->ODR ^= GPIO_Pin_13;
 
-                // Wait for zero cross trigger signal transition
-                WaitLoSIG;
-                WaitHiSIG;
+                Prof_Begin(PROF_CYCLE);
+                Prof_Begin(PROF_ZC_WAIT);
+                SYSMON_IDLE();
+                if (sync_capture && (int32_t)(ZeroCrossCount - sync_target) < 0) {
+                    // Wait for the zero-cross all armed boards agreed on,
+                    // while the edges keep coming
+                    last_zero_cross = ZeroCrossCount;
+                    WAIT_WHILE((int32_t)(ZeroCrossCount - sync_target) < 0, ZC_TIMEOUT_MS) {
+                        HAL_IDLE();
+                        if (ZeroCrossCount != last_zero_cross) {
+                            last_zero_cross = ZeroCrossCount;
+                            wait_start = TickCount;
+                        }
+                    }
+                    capture_seq = sync_seq;
+                } else {
+                    // Wait for zero cross trigger signal transition
+                    // (also when the armed zero-cross was missed, then the capture is not synchronized)
+                    WaitLoSIG;
+                    if (!wait_timeout)
+                        WaitHiSIG;
+                    capture_seq = 0;
+                }
+                sync_capture = 0;
+                capture_failed = wait_timeout;
+                if (capture_failed)
+                    countHealth(HEALTH_ZC_TIMEOUTS);
+                SYSMON_BUSY();
+                Prof_End(PROF_ZC_WAIT);
+                Prof_Begin(PROF_CAPTURE);
+                Trace(TRACE_CAPTURE_START, capture_seq);
+                capture_tick = TickCount;
 
                 flag = 0;
                 sample_counter = 0;
@@ -1053,17 +769,24 @@ int main (void) {
                 //     angle = (DWTticks / 72000000) * 18000 degrees/second
                 //           = DWTticks * 0.00025
         // !!! START CRITICAL CODE !!!
-                *DWT_CYCCNT = 0;  // DWT resolution is 13.8888888... ns per clock tick
-                while (sample_counter < 2048) {
+                if (capture_seq != 0)
+                    capture_start = ZeroCrossDWT;  // Count from the edge seen by the interrupt
+                else
+                    capture_start = *DWT_CYCCNT;  // DWT resolution is 13.8888888... ns per clock tick
+                while (sample_counter < 2048 && !capture_failed) {
                     // Wait for ADC data ready pin low state
                     WaitLoDRA;
+                    if (wait_timeout)
+                        break;
                     if (flag == 0) {  // Only once in the while :)
-                        CPUTicks = *DWT_CYCCNT;  // Save how many ticks
+                        CPUTicks = *DWT_CYCCNT - capture_start;  // Save how many ticks
         // !!! END CRITICAL CODE !!!
                         flag = 1;
                     }
                     // Wait for ADC data ready pin high state
                     WaitHiDRA;
+                    if (wait_timeout)
+                        break;
                     // Read data from ADC for all 6 channels
                     MCP3903_CS_low;
                     MSB0 = SPISend(0x41);
@@ -1090,6 +813,22 @@ int main (void) {
 
                     sample_counter++;
                 }
+                Prof_End(PROF_CAPTURE);
+
+                if (!capture_failed && wait_timeout) {
+                    // /DRA stuck, the MCP3903 is not running
+                    countHealth(HEALTH_DRA_TIMEOUTS);
+                    capture_failed = 1;
+                }
+                if (capture_failed) {
+                    countHealth(HEALTH_FAILED_CAPTURES);
+                } else {
+                    usRegHealthBuf[HEALTH_CAPTURE_MS] = TickCount - capture_tick;
+                    if (usRegHealthBuf[HEALTH_CAPTURE_MS] > CAPTURE_MAX_MS)
+                        countHealth(HEALTH_SLOW_CAPTURES);
+                    usRegHealthBuf[HEALTH_CAPTURES]++;
+                }
+                Trace(TRACE_CAPTURE_END, capture_failed);
             }
 
             // MAX, MIN and PHASE for CH0, CH1, CH2
@@ -1099,52 +838,91 @@ int main (void) {
                 minCH0 = 1000.0;
                 maxCH0 = -1000.0;
                 // Load data to FFT buffer and get MAX and MIN for this channel
+                Trace(TRACE_CHANNEL_START, 0);
+                Prof_Begin(PROF_SRAM_LOAD);
                 load_Channel_To_FFTbuffer(0);
+                Prof_End(PROF_SRAM_LOAD);
                 RMSVoltageCH0 = (maxCH0 - minCH0) * 0.353;
                 if (RMSVoltageCH0 > 0.015) {  // Equivalent to 2.678 mA on 5.6 ohm resistor (minimum value accepted)
                     // Apply Flat Top window to the signal
-                    apply_flattop_window(xyData, flattop_window, 2048);
+                    Prof_Begin(PROF_WINDOW);
+                    apply_flattop_window_packed(xyData, flattop_window, 2048);
+                    Prof_End(PROF_WINDOW);
                     // Compute FFT
-                    real_fft(xyData, 2048);
+                    Prof_Begin(PROF_FFT);
+                    real_fft_packed(xyData, 2048);
+                    Prof_End(PROF_FFT);
                     // Compute fundamental phase
+                    Prof_Begin(PROF_PHASE);
                     phaseCH0 = myfftPhase(xyData, 2048, 9);
+                    Prof_End(PROF_PHASE);
+                    // Keep the selected bins for the spectrum window
+                    update_Spectrum_Cache(0, 1);
                 } else {
                     phaseCH0 = 0.0;
+                    update_Spectrum_Cache(0, 0);
                 }
+                Trace(TRACE_CHANNEL_END, 0);
 
                 // Compute MAX, MIN and fundamental phase for channel CH1
                 minCH1 = 1000.0;
                 maxCH1 = -1000.0;
                 // Load data to FFT buffer and get MAX and MIN for this channel
+                Trace(TRACE_CHANNEL_START, 1);
+                Prof_Begin(PROF_SRAM_LOAD);
                 load_Channel_To_FFTbuffer(1);
+                Prof_End(PROF_SRAM_LOAD);
                 RMSVoltageCH1 = (maxCH1 - minCH1) * 0.353;
                 if (RMSVoltageCH1 > 0.015) {  // Equivalent to 2.678 mA on 5.6 ohm resistor (minimum value accepted)
                     // Apply Flat Top window to the signal
-                    apply_flattop_window(xyData, flattop_window, 2048);
+                    Prof_Begin(PROF_WINDOW);
+                    apply_flattop_window_packed(xyData, flattop_window, 2048);
+                    Prof_End(PROF_WINDOW);
                     // Compute FFT
-                    real_fft(xyData, 2048);
+                    Prof_Begin(PROF_FFT);
+                    real_fft_packed(xyData, 2048);
+                    Prof_End(PROF_FFT);
                     // Compute fundamental phase
+                    Prof_Begin(PROF_PHASE);
                     phaseCH1 = myfftPhase(xyData, 2048, 9);
+                    Prof_End(PROF_PHASE);
+                    // Keep the selected bins for the spectrum window
+                    update_Spectrum_Cache(1, 1);
                 } else {
                     phaseCH1 = 0.0;
+                    update_Spectrum_Cache(1, 0);
                 }
+                Trace(TRACE_CHANNEL_END, 1);
 
                 // Compute MAX, MIN and fundamental phase for channel CH2
                 minCH2 = 1000.0;
                 maxCH2 = -1000.0;
                 // Load data to FFT buffer and get MAX and MIN for this channel
+                Trace(TRACE_CHANNEL_START, 2);
+                Prof_Begin(PROF_SRAM_LOAD);
                 load_Channel_To_FFTbuffer(2);
+                Prof_End(PROF_SRAM_LOAD);
                 RMSVoltageCH2 = (maxCH2 - minCH2) * 0.353;
                 if (RMSVoltageCH2 > 0.015) {  // Equivalent to 2.678 mA on 5.6 ohm resistor (minimum value accepted)
                     // Apply Flat Top window to the signal
-                    apply_flattop_window(xyData, flattop_window, 2048);
+                    Prof_Begin(PROF_WINDOW);
+                    apply_flattop_window_packed(xyData, flattop_window, 2048);
+                    Prof_End(PROF_WINDOW);
                     // Compute FFT
-                    real_fft(xyData, 2048);
+                    Prof_Begin(PROF_FFT);
+                    real_fft_packed(xyData, 2048);
+                    Prof_End(PROF_FFT);
                     // Compute fundamental phase
+                    Prof_Begin(PROF_PHASE);
                     phaseCH2 = myfftPhase(xyData, 2048, 9);
+                    Prof_End(PROF_PHASE);
+                    // Keep the selected bins for the spectrum window
+                    update_Spectrum_Cache(2, 1);
                 } else {
                     phaseCH2 = 0.0;
+                    update_Spectrum_Cache(2, 0);
                 }
+                Trace(TRACE_CHANNEL_END, 2);
             }
 
             // MAX, MIN and PHASE for CH3, CH4, CH5
@@ -1154,53 +932,93 @@ int main (void) {
                 minCH3 = 1000.0;
                 maxCH3 = -1000.0;
                 // Load data to FFT buffer and get MAX and MIN for this channel
+                Trace(TRACE_CHANNEL_START, 3);
+                Prof_Begin(PROF_SRAM_LOAD);
                 load_Channel_To_FFTbuffer(3);
+                Prof_End(PROF_SRAM_LOAD);
                 RMSVoltageCH3 = (maxCH3 - minCH3) * 0.353;
                 if (RMSVoltageCH3 > 0.015) {  // Equivalent to 2.678 mA on 5.6 ohm resistor (minimum value accepted)
                     // Apply Flat Top window to the signal
-                    apply_flattop_window(xyData, flattop_window, 2048);
+                    Prof_Begin(PROF_WINDOW);
+                    apply_flattop_window_packed(xyData, flattop_window, 2048);
+                    Prof_End(PROF_WINDOW);
                     // Compute FFT
-                    real_fft(xyData, 2048);
+                    Prof_Begin(PROF_FFT);
+                    real_fft_packed(xyData, 2048);
+                    Prof_End(PROF_FFT);
                     // Compute fundamental phase
+                    Prof_Begin(PROF_PHASE);
                     phaseCH3 = myfftPhase(xyData, 2048, 9);
+                    Prof_End(PROF_PHASE);
+                    // Keep the selected bins for the spectrum window
+                    update_Spectrum_Cache(3, 1);
                 } else {
                     phaseCH3 = 0.0;
+                    update_Spectrum_Cache(3, 0);
                 }
+                Trace(TRACE_CHANNEL_END, 3);
 
                 // Compute MAX, MIN and fundamental phase for channel CH4
                 minCH4 = 1000.0;
                 maxCH4 = -1000.0;
                 // Load data to FFT buffer and get MAX and MIN for this channel
+                Trace(TRACE_CHANNEL_START, 4);
+                Prof_Begin(PROF_SRAM_LOAD);
                 load_Channel_To_FFTbuffer(4);
+                Prof_End(PROF_SRAM_LOAD);
                 RMSVoltageCH4 = (maxCH4 - minCH4) * 0.353;
                 if (RMSVoltageCH4 > 0.015) {  // Equivalent to 2.678 mA on 5.6 ohm resistor (minimum value accepted)
                     // Apply Flat Top window to the signal
-                    apply_flattop_window(xyData, flattop_window, 2048);
+                    Prof_Begin(PROF_WINDOW);
+                    apply_flattop_window_packed(xyData, flattop_window, 2048);
+                    Prof_End(PROF_WINDOW);
                     // Compute FFT
-                    real_fft(xyData, 2048);
+                    Prof_Begin(PROF_FFT);
+                    real_fft_packed(xyData, 2048);
+                    Prof_End(PROF_FFT);
                     // Compute fundamental phase
+                    Prof_Begin(PROF_PHASE);
                     phaseCH4 = myfftPhase(xyData, 2048, 9);
+                    Prof_End(PROF_PHASE);
+                    // Keep the selected bins for the spectrum window
+                    update_Spectrum_Cache(4, 1);
                 } else {
                     phaseCH4 = 0.0;
+                    update_Spectrum_Cache(4, 0);
                 }
+                Trace(TRACE_CHANNEL_END, 4);
 
                 // Compute MAX, MIN and fundamental phase for channel CH5
                 minCH5 = 1000.0;
                 maxCH5 = -1000.0;
                 // Load data to FFT buffer and get MAX and MIN for this channel
+                Trace(TRACE_CHANNEL_START, 5);
+                Prof_Begin(PROF_SRAM_LOAD);
                 load_Channel_To_FFTbuffer(5);
+                Prof_End(PROF_SRAM_LOAD);
                 RMSVoltageCH5 = (maxCH5 - minCH5) * 0.353;
                 if (RMSVoltageCH5 > 0.015) {  // Equivalent to 2.678 mA on 5.6 ohm resistor (minimum value accepted)
                     // Apply Flat Top window to the signal
-                    apply_flattop_window(xyData, flattop_window, 2048);
+                    Prof_Begin(PROF_WINDOW);
+                    apply_flattop_window_packed(xyData, flattop_window, 2048);
+                    Prof_End(PROF_WINDOW);
                     // Compute FFT
-                    real_fft(xyData, 2048);
+                    Prof_Begin(PROF_FFT);
+                    real_fft_packed(xyData, 2048);
+                    Prof_End(PROF_FFT);
                     // Compute fundamental phase
+                    Prof_Begin(PROF_PHASE);
                     phaseCH5 = myfftPhase(xyData, 2048, 9);
+                    Prof_End(PROF_PHASE);
+                    // Keep the selected bins for the spectrum window
+                    update_Spectrum_Cache(5, 1);
                 } else {
                     phaseCH5 = 0.0;
+                    update_Spectrum_Cache(5, 0);
                 }
+                Trace(TRACE_CHANNEL_END, 5);
 
+                Prof_Begin(PROF_PUBLISH);
                 // Save RMS voltage to Modbus server
                 writeHoldingRegister(1, adjust_voltage(RMSVoltageCH0));
                 writeHoldingRegister(2, adjust_voltage(RMSVoltageCH1));
@@ -1211,18 +1029,39 @@ int main (void) {
 
                 // Convert DWT ticks to angle
                 float phase_difference = (float)(CPUTicks * 0.00025);
-
-                // Write phase to modbus server
-                writeHoldingRegister( 7, adjust_phase(phaseCH0, phase_difference));
-                writeHoldingRegister( 8, adjust_phase(phaseCH1, phase_difference));
-                writeHoldingRegister( 9, adjust_phase(phaseCH2, phase_difference));
-                writeHoldingRegister(10, adjust_phase(phaseCH3, phase_difference));
-                writeHoldingRegister(11, adjust_phase(phaseCH4, phase_difference));
-                writeHoldingRegister(12, adjust_phase(phaseCH5, phase_difference));
+                // adjust_phase() publishes 0 for all the channels then
+                if (phase_difference >= DSP_MAX_PHASE_DIFFERENCE)
+                    countHealth(HEALTH_PHASE_REJECTED);
+
+                // A running calibration measures the phases before the offsets
+                float phases[6] = { phaseCH0, phaseCH1, phaseCH2, phaseCH3, phaseCH4, phaseCH5 };
+                float rms[6] = { RMSVoltageCH0, RMSVoltageCH1, RMSVoltageCH2,
+                                 RMSVoltageCH3, RMSVoltageCH4, RMSVoltageCH5 };
+                Cal_Measure(phases, rms, phase_difference);
+
+                // Write phase to modbus server, minus the delays of this board
+                writeHoldingRegister( 7, adjust_phase(Cal_Correct(0, phaseCH0), phase_difference));
+                writeHoldingRegister( 8, adjust_phase(Cal_Correct(1, phaseCH1), phase_difference));
+                writeHoldingRegister( 9, adjust_phase(Cal_Correct(2, phaseCH2), phase_difference));
+                writeHoldingRegister(10, adjust_phase(Cal_Correct(3, phaseCH3), phase_difference));
+                writeHoldingRegister(11, adjust_phase(Cal_Correct(4, phaseCH4), phase_difference));
+                writeHoldingRegister(12, adjust_phase(Cal_Correct(5, phaseCH5), phase_difference));
+
+                // Tell the master which (synchronized) capture these results are from
+                writeHoldingRegister(REG_CAPTURE_SEQ, capture_seq);
+
+                // New results, the master writes 0 after reading them
+                writeHoldingRegister(REG_RESULT_READY, 1);
+                // Keep them with the trend of the last ones (900..)
+                History_Add(capture_seq);
+                Trace(TRACE_PUBLISH, capture_seq);
+                Prof_End(PROF_PUBLISH);
+                Prof_End(PROF_CYCLE);
             }
 
             step_counter++;
-            if (step_counter >= 3) {   // Reset state machine
+            if (step_counter >= 3 || capture_failed) {   // Reset state machine
+                capture_failed = 0;
                 step_counter = 0;
                 //GPIOC->ODR ^= GPIO_Pin_13;
             }
@@ -1231,6 +1070,127 @@ int main (void) {
     }
 }
 
+#ifndef HAL_SIM
+// The peripherals of the board, the simulator has its own (treceri/sim/hal_sim.c)
+void Board_Init(void) {
+    GPIO_InitTypeDef GPIO_InitStructure;
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+
+    /************************************************************
+    *   Enable Systick interrupt at 1 ms
+    *************************************************************/
+    if (SysTick_Config(72000)) {  // 1 ms interrupt 72 MHz / 72000 = 1000
+        // Capture error
+        while (1);
+    }
+
+    /************************************************************
+    *   Init B6,B7,B8,B9,B12,B13,B14,B15 relays
+    *************************************************************/
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB , ENABLE);
+    GPIO_StructInit(&GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_15 | GPIO_Pin_14 | GPIO_Pin_13 | GPIO_Pin_12 | GPIO_Pin_9 | GPIO_Pin_8 | GPIO_Pin_7 | GPIO_Pin_6;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
+    GPIO_Init(GPIOB, &GPIO_InitStructure);
+
+    /************************************************************
+    *   All relays OFF
+    *************************************************************/
+    GPIOB->BSRR = GPIO_Pin_15 |GPIO_Pin_14 |GPIO_Pin_13 | GPIO_Pin_12 |GPIO_Pin_9 |GPIO_Pin_8 | GPIO_Pin_7 | GPIO_Pin_6;
+
+    /************************************************************
+    *   Init led PC13 (BluePill LED)
+    *************************************************************/
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC , ENABLE);
+    GPIO_StructInit(&GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_13;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
+    GPIO_Init(GPIOC, &GPIO_InitStructure);
+
+    /************************************************************
+    *   Init PB0 & PB1 side switching (A,B,C / a, b, c)
+    *************************************************************/
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB , ENABLE);
+    GPIO_StructInit(&GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_1 | GPIO_Pin_0;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
+    GPIO_Init(GPIOB, &GPIO_InitStructure);
+    // Set pins to LOW
+    GPIOB->BRR = GPIO_Pin_1 |GPIO_Pin_0;
+
+    /************************************************************
+    *   Init PA2 as input floating to get /DRA channel
+    *************************************************************/
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA , ENABLE);
+    GPIO_StructInit(&GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_2;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_Init(GPIOA, &GPIO_InitStructure);
+
+    /************************************************************
+    *   Start TIM2_CH2 on pin PA1 at 3 MHz, 50 % duty
+    *   as clock for MCP3903 ADC
+    *************************************************************/
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA | RCC_APB2Periph_AFIO, ENABLE);
+    GPIO_StructInit(&GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin =  GPIO_Pin_1;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
+    GPIO_Init( GPIOA, &GPIO_InitStructure );
+
+    /************************************************************
+    *   TIM2 clock enable
+    *************************************************************/
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2 , ENABLE);
+    TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+    TIM_TimeBaseStructure.TIM_Prescaler = 12 - 1;  // 72 MHz / 12 = 6 MHz
+    TIM_TimeBaseStructure.TIM_Period = 2 - 1;  // 6 MHz / 2 = 3 MHz  / 256 = 11718.75
+    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM2, &TIM_TimeBaseStructure);
+
+    TIM_OCStructInit(&TIM_OCInitStructure);
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OCInitStructure.TIM_Pulse = 0;
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OC2Init(TIM2, &TIM_OCInitStructure);  // Channel 2 configuration = PA1
+
+    TIM_ARRPreloadConfig(TIM2, ENABLE);
+    TIM_CtrlPWMOutputs(TIM2, ENABLE);
+    TIM_Cmd(TIM2, ENABLE);
+    TIM2->CCR2 = 1;
+
+    /************************************************************
+    *   Init PB11 as input floating to get zero-cross impulse
+    *************************************************************/
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB , ENABLE);
+    GPIO_InitStructure.GPIO_Pin =  GPIO_Pin_11;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_Init(GPIOB, &GPIO_InitStructure);
+}
+
+void ZeroCross_Init(void) {
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    AFIO->EXTICR[2] = (AFIO->EXTICR[2] & ~AFIO_EXTICR3_EXTI11) | AFIO_EXTICR3_EXTI11_PB;
+    EXTI->RTSR |= EXTI_RTSR_TR11;
+    EXTI->FTSR &= ~EXTI_FTSR_TR11;
+    EXTI->PR = EXTI_PR_PR11;
+    EXTI->IMR |= EXTI_IMR_MR11;
+    NVIC_InitStructure.NVIC_IRQChannel = EXTI15_10_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;  // Below the Modbus timer and USART
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
 void SPI_init(void) {
     SPI_InitTypeDef  SPI_InitStructure;
     GPIO_InitTypeDef GPIO_InitStructure;
@@ -1272,7 +1232,7 @@ void SPI_init(void) {
     SPI_Cmd(SPI1, ENABLE);
 }
 
-uint8_t SPISend(uint8_t data) {
+HAL_RAMFUNC uint8_t SPISend(uint8_t data) {
     /******************************************************
     *   ====> SPI interface works in mode CPOL = 0 and CPHA = 0
     *   Set the data register to the byte to be transmitted
@@ -1295,6 +1255,7 @@ uint8_t SPISend(uint8_t data) {
     // Return the data received on MISO pin.
     return(SPI1->DR);
 }
+#endif
 
 void MCP3903_init(void) {
     MCP3903_CS_low;
@@ -5,3 +5,148 @@
 //extern u16 usRegInputBuf[100+1];
 extern u16 usRegHoldingBuf[40+1];
 extern u8 usRegCoilBuf[64/8+1];    // We have 64 coils
+
+// Raw signals record stored in the external 23K256 SRAM
+#define SRAM_RECORD_SAMPLES    2048  // Samples for each channel
+#define SRAM_RECORD_CHANNELS   6     // Channels stored interleaved, 12 bytes per sample
+
+// Synchronized capture, holding register index (Modbus address + 1)
+#define REG_CAPTURE_SEQ        13    // Sequence number of the published results, 0 = free running
+#define REG_SYNC_DELAY         14    // Zero-crosses from the arm frame to the capture
+#define REG_SYNC_ARM           15    // Write a sequence number (broadcast) to arm the capture
+#define SYNC_DELAY_DEFAULT     50    // 1 second at 50 Hz, enough to finish a compute step
+
+// Modbus event queue statistics (read only)
+#define REG_EVENT_OVERFLOWS    16    // Events dropped since reset
+#define REG_EVENT_HIGH_WATER   17    // Most events waiting at once
+
+// Measurement scheduler
+#define REG_MEAS_PERIOD        18    // ms between captures, 0 = one step after each Modbus reply
+#define REG_MEAS_TRIGGER       19    // Write non zero to start a cycle now, reads back 0
+#define REG_RESULT_READY       20    // 1 when new results are published, the master writes 0
+
+// Phase calibration, see calibration.h
+#define REG_CAL_COMMAND        21    // CAL_CMD_..., reads back 0 when done
+#define REG_CAL_REF_PHASE      22    // Known phase of the injected signal, 0.01 degrees
+#define REG_CAL_STATUS         23    // CAL_STATUS_... (read only)
+#define REG_CAL_OFFSET         24    // 24..29 phase offset of CH0..CH5, signed 0.01 degrees
+#define REG_CAL_AVERAGE        30    // Captures averaged by a measurement, 1..100
+#define CAL_AVERAGE_DEFAULT    8
+
+void writeHoldingRegister (uint8_t reg_index, uint16_t reg_val);
+uint16_t readHoldingRegister (uint8_t reg_index);
+
+// Zero-cross counter (EXTI11 on PB11), and its value at the end of the last frame
+extern volatile uint32_t ZeroCrossCount;
+extern volatile uint32_t ZeroCrossDWT;
+extern volatile uint32_t FrameZeroCross;
+extern uint32_t SyncArmZeroCross;
+
+void read_Channel_From_SRAM (uint8_t channel, uint16_t first_sample, uint16_t num_samples, uint8_t *dest);
+
+// Spectrum window, a range of FFT bins of one channel, cached once per cycle.
+// Modbus address 100.. (buffer index = address + 1, the same as the holding registers)
+#define REG_SPECTRUM_START     101
+#define SPECTRUM_CHANNEL       0     // 0..5, offsets in usRegSpectrumBuf
+#define SPECTRUM_FIRST_BIN     1     // First bin, 0..1023 (bin width 5.722 Hz)
+#define SPECTRUM_NUM_BINS      2     // Number of bins, 1..SPECTRUM_MAX_BINS
+#define SPECTRUM_FLAGS         3     // Bit 0 - add phase after each magnitude
+#define SPECTRUM_DATA          4     // First cached value (read only)
+#define SPECTRUM_MAX_BINS      60
+#define SPECTRUM_NREGS         (SPECTRUM_DATA + 2 * SPECTRUM_MAX_BINS)  // 124, fits in one read
+#define SPECTRUM_FLAG_PHASE    0x0001
+
+extern u16 usRegSpectrumBuf[SPECTRUM_NREGS];
+
+// Cycle profiler of the main loop stages, see profiler.h.
+// Modbus address 300.. (buffer index = address + 1), after the spectrum window (100..223)
+#define REG_PROFILE_START      301
+#define PROFILE_CONTROL        0     // Write 1 to reset min and max, reads back 0
+#define PROFILE_NUM_STAGES     1     // Read only from here
+#define PROFILE_CLOCK_MHZ      2     // DWT cycles per microsecond
+#define PROFILE_DATA           3     // 6 per stage: last, min, max, each high word first
+#define PROFILE_STAGES         9
+#define PROFILE_NREGS          (PROFILE_DATA + 6 * PROFILE_STAGES)  // 57
+
+extern u16 usRegProfileBuf[PROFILE_NREGS];
+
+// Health counters, Modbus address 400.. (buffer index = address + 1), read only
+// but the control. The counters stop at 0xFFFF, the master writes 1 to clear them.
+#define REG_HEALTH_START       401
+#define HEALTH_CONTROL         0     // Write 1 to clear all the counters, reads back 0
+#define HEALTH_UART_OVERRUNS   1     // Bytes lost by the USART (ORE)
+#define HEALTH_CRC_ERRORS      2     // Frames too short or with a bad CRC
+#define HEALTH_RX_OVERFLOWS    3     // Frames longer than the receive buffer
+#define HEALTH_PHASE_REJECTED  4     // Captures published with phase 0, CPUTicks out of range
+#define HEALTH_DRA_TIMEOUTS    5     // /DRA stuck, the MCP3903 gives no samples
+#define HEALTH_ZC_TIMEOUTS     6     // No zero-cross edge for 100 ms
+#define HEALTH_FAILED_CAPTURES 7     // Captures dropped for one of the 2 above
+#define HEALTH_SLOW_CAPTURES   8     // Captures longer than 200 ms
+#define HEALTH_CAPTURE_MS      9     // Duration of the last capture, ms
+#define HEALTH_CAPTURES        10    // Good captures, wraps at 65535
+#define HEALTH_NREGS           11
+
+extern u16 usRegHealthBuf[HEALTH_NREGS];
+
+// System monitor, see sysmon.h. Modbus address 500.. (buffer index = address + 1),
+// read only but the control. Sizes in bytes, 0 = not known (simulator).
+#define REG_SYSTEM_START       501
+#define SYSTEM_CONTROL         0     // Write 1 to reset the peak CPU load, reads back 0
+#define SYSTEM_CPU_LOAD        1     // Busy time of the last second, 0.1 %
+#define SYSTEM_CPU_LOAD_MAX    2     // Highest SYSTEM_CPU_LOAD
+#define SYSTEM_STACK_SIZE      3
+#define SYSTEM_STACK_USED      4     // High-water mark since reset
+#define SYSTEM_RAM_SIZE        5
+#define SYSTEM_DATA_SIZE       6     // .data
+#define SYSTEM_BSS_SIZE        7     // .bss, with the FFT buffer
+#define SYSTEM_FFT_BUFFER      8     // xyData
+#define SYSTEM_RAM_FREE        9     // Neither data nor stack
+#define SYSTEM_FLASH_SIZE      10    // Program area (after the bootloader)
+#define SYSTEM_FLASH_USED      11    // Code, constants and the .data initial values
+#define SYSTEM_RAMFUNC_SIZE    12    // Code run from SRAM, part of .data
+#define SYSTEM_NREGS           13
+
+extern u16 usRegSystemBuf[SYSTEM_NREGS];
+
+// Event trace, see trace.h. Modbus address 600.. (buffer index = address + 1),
+// the master writes the control and the mask, the rest is read only.
+#define REG_TRACE_START        601
+#define TRACE_CONTROL          0     // TRACE_STOP, TRACE_CLEAR
+#define TRACE_MASK             1     // Bit n records the event id n
+#define TRACE_HEAD             2     // Next entry written, the oldest one when the ring is full
+#define TRACE_COUNT            3     // Events recorded, wraps at 65535
+#define TRACE_NUM_ENTRIES      4
+#define TRACE_CLOCK_MHZ        5     // DWT cycles per microsecond
+#define TRACE_DATA             6     // 4 per entry: time high, time low, event id, argument
+#define TRACE_ENTRIES          64    // Power of 2
+#define TRACE_NREGS            (TRACE_DATA + 4 * TRACE_ENTRIES)  // 262, 3 reads
+
+extern u16 usRegTraceBuf[TRACE_NREGS];
+
+// Result history, see history.h. Modbus address 900.. (buffer index = address + 1),
+// after the trace (600..861). The master writes the control and the decimation.
+#define REG_HISTORY_START      901
+#define HISTORY_CONTROL        0     // HISTORY_CLEAR
+#define HISTORY_DECIMATION     1     // Keep one published result in N, 0 = stopped
+#define HISTORY_HEAD           2     // Next entry written, the oldest one when the ring is full
+#define HISTORY_COUNT          3     // Entries recorded, wraps at 65535
+#define HISTORY_NUM_ENTRIES    4
+#define HISTORY_USED           5     // Entries in the window of the statistics
+#define HISTORY_STATS          6     // HISTORY_STAT_... for CH0, then CH1, ...
+#define HISTORY_STAT_RMS_MEAN    0   // RMS voltage * 10000
+#define HISTORY_STAT_RMS_STD     1
+#define HISTORY_STAT_RMS_RATE    2   // Signed, RMS voltage * 10000 per minute
+#define HISTORY_STAT_PHASE_MEAN  3   // Phase * 100, 0..35999
+#define HISTORY_STAT_PHASE_STD   4
+#define HISTORY_STAT_PHASE_RATE  5   // Signed, phase * 100 per minute
+#define HISTORY_STAT_REGS        6
+#define HISTORY_DATA           (HISTORY_STATS + 6 * HISTORY_STAT_REGS)  // 42
+#define HISTORY_ENTRY_TIME     0     // ms since reset, high word first
+#define HISTORY_ENTRY_SEQ      2     // REG_CAPTURE_SEQ
+#define HISTORY_ENTRY_RMS      3     // CH0..CH5, as registers 1..6
+#define HISTORY_ENTRY_PHASE    9     // CH0..CH5, as registers 7..12
+#define HISTORY_ENTRY_REGS     15
+#define HISTORY_ENTRIES        32    // Power of 2
+#define HISTORY_NREGS          (HISTORY_DATA + HISTORY_ENTRY_REGS * HISTORY_ENTRIES)  // 522, 5 reads
+
+extern u16 usRegHistoryBuf[HISTORY_NREGS];
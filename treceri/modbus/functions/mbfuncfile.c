@@ -0,0 +1,138 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it 
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any 
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original 
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness 
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any 
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/* ----------------------- System includes ----------------------------------*/
+//#include "stdlib.h"
+//#include "string.h"
+
+/* ----------------------- Platform includes --------------------------------*/
+#include "port.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mb.h"
+#include "mbframe.h"
+#include "mbproto.h"
+#include "mbconfig.h"
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_PDU_FUNC_FILE_BYTECNT_OFF            ( MB_PDU_DATA_OFF + 0 )
+#define MB_PDU_FUNC_FILE_SUBREQ_OFF             ( MB_PDU_DATA_OFF + 1 )
+#define MB_PDU_FUNC_FILE_SUBREQ_SIZE            ( 7 )
+#define MB_PDU_FUNC_FILE_SUBREQ_MAX             ( 35 )
+#define MB_PDU_FUNC_FILE_BYTECNT_MIN            ( 0x07 )
+#define MB_PDU_FUNC_FILE_BYTECNT_MAX            ( 0xF5 )
+#define MB_PDU_FUNC_FILE_RESP_SIZE_MAX          ( 0xF5 )
+#define MB_PDU_FUNC_FILE_REF_TYPE               ( 6 )
+
+/* ----------------------- Static functions ---------------------------------*/
+eMBException    prveMBError2Exception( eMBErrorCode eErrorCode );
+
+/* ----------------------- Start implementation -----------------------------*/
+
+#if MB_FUNC_READ_FILE_RECORD_ENABLED > 0
+
+/* Request:  function code, byte count, n x ( reference type, file number,
+ *           record number, record length ).
+ * Response: function code, response data length, n x ( file response length,
+ *           reference type, record data ).
+ *
+ * The response is written over the request in the same frame buffer, so the
+ * sub-requests are decoded first. The record data is filled in directly by
+ * the eMBFileRecordCB( ) callback, there is no other copy of it.
+ */
+eMBException
+eMBFuncReadFileRecord( UCHAR * pucFrame, USHORT * usLen )
+{
+    USHORT          usFileNumber[MB_PDU_FUNC_FILE_SUBREQ_MAX];
+    USHORT          usRecordNumber[MB_PDU_FUNC_FILE_SUBREQ_MAX];
+    USHORT          usRecordLength[MB_PDU_FUNC_FILE_SUBREQ_MAX];
+    USHORT          usRespLength;
+    UCHAR           ucByteCount;
+    UCHAR           ucNSubReq;
+    UCHAR          *pucFrameCur;
+    int             i;
+
+    eMBException    eStatus = MB_EX_NONE;
+    eMBErrorCode    eRegStatus;
+
+    if( *usLen < ( MB_PDU_FUNC_FILE_SUBREQ_OFF + MB_PDU_FUNC_FILE_SUBREQ_SIZE ) )
+    {
+        /* Can't be a valid request because the length is incorrect. */
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+
+    ucByteCount = pucFrame[MB_PDU_FUNC_FILE_BYTECNT_OFF];
+    if( ( ucByteCount < MB_PDU_FUNC_FILE_BYTECNT_MIN ) ||
+        ( ucByteCount > MB_PDU_FUNC_FILE_BYTECNT_MAX ) ||
+        ( ( ucByteCount % MB_PDU_FUNC_FILE_SUBREQ_SIZE ) != 0 ) ||
+        ( *usLen != ( USHORT )( MB_PDU_FUNC_FILE_SUBREQ_OFF + ucByteCount ) ) )
+    {
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+
+    /* Decode all sub-requests and check that the answer fits in one frame. */
+    ucNSubReq = ucByteCount / MB_PDU_FUNC_FILE_SUBREQ_SIZE;
+    usRespLength = 0;
+    pucFrameCur = &pucFrame[MB_PDU_FUNC_FILE_SUBREQ_OFF];
+    for( i = 0; i < ucNSubReq; i++ )
+    {
+        if( pucFrameCur[0] != MB_PDU_FUNC_FILE_REF_TYPE )
+        {
+            return MB_EX_ILLEGAL_DATA_VALUE;
+        }
+        usFileNumber[i] = ( USHORT )( pucFrameCur[1] << 8 ) | pucFrameCur[2];
+        usRecordNumber[i] = ( USHORT )( pucFrameCur[3] << 8 ) | pucFrameCur[4];
+        usRecordLength[i] = ( USHORT )( pucFrameCur[5] << 8 ) | pucFrameCur[6];
+
+        if( ( usRecordLength[i] == 0 ) ||
+            ( usRecordLength[i] > ( MB_PDU_FUNC_FILE_RESP_SIZE_MAX - 2 ) / 2 ) )
+        {
+            return MB_EX_ILLEGAL_DATA_VALUE;
+        }
+        usRespLength += 2 + usRecordLength[i] * 2;
+        if( usRespLength > MB_PDU_FUNC_FILE_RESP_SIZE_MAX )
+        {
+            return MB_EX_ILLEGAL_DATA_VALUE;
+        }
+        pucFrameCur += MB_PDU_FUNC_FILE_SUBREQ_SIZE;
+    }
+
+    /* Build the response in place. */
+    pucFrameCur = &pucFrame[MB_PDU_FUNC_OFF];
+    *pucFrameCur++ = MB_FUNC_READ_FILE_RECORD;
+    *pucFrameCur++ = ( UCHAR )usRespLength;
+    for( i = 0; i < ucNSubReq; i++ )
+    {
+        *pucFrameCur++ = ( UCHAR )( 1 + usRecordLength[i] * 2 );
+        *pucFrameCur++ = MB_PDU_FUNC_FILE_REF_TYPE;
+
+        /* Make callback to fill the record data. */
+        eRegStatus = eMBFileRecordCB( pucFrameCur, usFileNumber[i],
+                                      usRecordNumber[i], usRecordLength[i] );
+        if( eRegStatus != MB_ENOERR )
+        {
+            eStatus = prveMBError2Exception( eRegStatus );
+            break;
+        }
+        pucFrameCur += usRecordLength[i] * 2;
+    }
+    *usLen = ( USHORT )( MB_PDU_FUNC_FILE_SUBREQ_OFF + usRespLength );
+
+    return eStatus;
+}
+
+#endif
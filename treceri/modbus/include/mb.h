@@ -411,6 +411,30 @@ eMBErrorCode    eMBRegCoilsCB( UCHAR * pucRegBuffer, USHORT usAddress,
 eMBErrorCode    eMBRegDiscreteCB( UCHAR * pucRegBuffer, USHORT usAddress,
                                   USHORT usNDiscrete );
 
+/*! \ingroup modbus_registers
+ * \brief Callback function used if a <em>File Record</em> is read by the
+ *   protocol stack (function code 20). The first register of the record
+ *   is given by \c usRecordNumber and the last one by
+ *   <tt>usRecordNumber + usRecordLength - 1</tt>.
+ *
+ * \param pucRecordBuffer The buffer should be updated with the record
+ *   values, two bytes per register with the high byte first.
+ * \param usFileNumber The file number from the sub-request.
+ * \param usRecordNumber The first record (register) in the file.
+ * \param usRecordLength Number of registers requested.
+ *
+ * \return The function must return one of the following error codes:
+ *   - eMBErrorCode::MB_ENOERR If no error occurred. In this case a normal
+ *       Modbus response is sent.
+ *   - eMBErrorCode::MB_ENOREG If the file or the record range does not
+ *       exist. In this case a <b>ILLEGAL DATA ADDRESS</b> exception frame
+ *       is sent as a response.
+ *   - eMBErrorCode::MB_EIO If an unrecoverable error occurred. In this case
+ *       a <b>SLAVE DEVICE FAILURE</b> exception is sent as a response.
+ */
+eMBErrorCode    eMBFileRecordCB( UCHAR * pucRecordBuffer, USHORT usFileNumber,
+                                 USHORT usRecordNumber, USHORT usRecordLength );
+
 #ifdef __cplusplus
 PR_END_EXTERN_C
 #endif
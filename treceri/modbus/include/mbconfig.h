@@ -125,6 +125,9 @@ PR_BEGIN_EXTERN_C
 /*! \brief If the <em>Read/Write Multiple Registers</em> function should be enabled. */
 #define MB_FUNC_READWRITE_HOLDING_ENABLED       (  1 )
 
+/*! \brief If the <em>Read File Record</em> function should be enabled. */
+#define MB_FUNC_READ_FILE_RECORD_ENABLED        (  1 )
+
 /*! @} */
 #ifdef __cplusplus
     PR_END_EXTERN_C
@@ -47,6 +47,7 @@
 //#define MB_FUNC_READ_INPUT_REGISTER           (  4 )
 #define MB_FUNC_WRITE_REGISTER                (  6 )
 #define MB_FUNC_WRITE_MULTIPLE_REGISTERS      ( 16 )
+#define MB_FUNC_READ_FILE_RECORD              ( 20 )
 #define MB_FUNC_READWRITE_MULTIPLE_REGISTERS  ( 23 )
 #define MB_FUNC_DIAG_READ_EXCEPTION           (  7 )
 #define MB_FUNC_DIAG_DIAGNOSTIC               (  8 )
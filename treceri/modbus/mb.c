@@ -115,6 +115,9 @@ static xMBFunctionHandler xFuncHandlers[MB_FUNC_HANDLERS_MAX] = {
 #if MB_FUNC_WRITE_MULTIPLE_COILS_ENABLED > 0
     {MB_FUNC_WRITE_MULTIPLE_COILS, eMBFuncWriteMultipleCoils},
 #endif
+#if MB_FUNC_READ_FILE_RECORD_ENABLED > 0
+    {MB_FUNC_READ_FILE_RECORD, eMBFuncReadFileRecord},
+#endif
 //#if MB_FUNC_READ_DISCRETE_INPUTS_ENABLED > 0
 //    {MB_FUNC_READ_DISCRETE_INPUTS, eMBFuncReadDiscreteInputs},
 //#endif
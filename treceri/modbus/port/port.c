@@ -21,39 +21,160 @@ u8 REG_HOLDING_NREGS=41, REG_COIL_NREGS=65;
 u8 usRegHoldingStart=0, usRegCoilsStart=0;
 
 
+// A written spectrum window must stay in the 1024 bins and the cache:
+// SPECTRUM_FIRST_BIN 0..1023, SPECTRUM_NUM_BINS 1..SPECTRUM_MAX_BINS
+static eMBErrorCode
+prveMBSpectrumWindowCheck( UCHAR * pucRegBuffer, int iRegIndex, USHORT usNRegs )
+{
+    USHORT          usValue;
+    int             i;
+
+    for( i = 0; i < usNRegs; i++ )
+    {
+        usValue = ( USHORT )( ( pucRegBuffer[2 * i] << 8 ) | pucRegBuffer[2 * i + 1] );
+        if( ( iRegIndex + i == SPECTRUM_FIRST_BIN ) && ( usValue > 1023 ) )
+        {
+            return MB_EINVAL;
+        }
+        if( ( iRegIndex + i == SPECTRUM_NUM_BINS ) && ( ( usValue == 0 ) || ( usValue > SPECTRUM_MAX_BINS ) ) )
+        {
+            return MB_EINVAL;
+        }
+    }
+    return MB_ENOERR;
+}
+
+// Copy usNRegs registers between a register array and the Modbus frame
+static eMBErrorCode
+prveMBRegBufferCB( u16 * pusRegBuf, UCHAR * pucRegBuffer, int iRegIndex, USHORT usNRegs, eMBRegisterMode eMode )
+{
+	// u16 *PRT=(u16*)pucRegBuffer;
+
+    switch ( eMode )
+    {
+        case MB_REG_READ:
+            while( usNRegs > 0 )
+            {
+                // *PRT++ = __REV16(pusRegBuf[iRegIndex++]); // Sequence data transfer REV
+                *pucRegBuffer++ = ( unsigned char )( pusRegBuf[iRegIndex] >> 8 );
+                *pucRegBuffer++ = ( unsigned char )( pusRegBuf[iRegIndex] & 0xFF );
+                iRegIndex++;
+                usNRegs--;
+            }
+            break;
+
+        case MB_REG_WRITE:
+            while( usNRegs > 0 )
+            {
+                // pusRegBuf[iRegIndex++] = __REV16(*PRT++); // Sequence data transfer REV
+                pusRegBuf[iRegIndex] = *pucRegBuffer++ << 8;
+                pusRegBuf[iRegIndex] |= *pucRegBuffer++;
+                iRegIndex++;
+                usNRegs--;
+            }
+    }
+    return MB_ENOERR;
+}
+
+
 // Register read and write commands to function supports read and write 0x06 0x03
 eMBErrorCode
 eMBRegHoldingCB( UCHAR * pucRegBuffer, USHORT usAddress, USHORT usNRegs, eMBRegisterMode eMode )
 {
     eMBErrorCode    eStatus = MB_ENOERR;
     int             iRegIndex;
-	// u16 *PRT=(u16*)pucRegBuffer;
 
     if( ( usAddress >= REG_HOLDING_START ) && ( usAddress + usNRegs <= REG_HOLDING_START + REG_HOLDING_NREGS ) )
     {
         iRegIndex = ( int )( usAddress - usRegHoldingStart );
-        switch ( eMode )
+        eStatus = prveMBRegBufferCB( usRegHoldingBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
+        // Latch the zero-cross count of this frame when the synchronized capture is armed
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex <= REG_SYNC_ARM ) && ( iRegIndex + usNRegs > REG_SYNC_ARM ) )
         {
-            case MB_REG_READ:
-                while( usNRegs > 0 )
-                {
-                    // *PRT++ = __REV16(usRegHoldingBuf[iRegIndex++]); // Sequence data transfer REV16.W
-                    *pucRegBuffer++ = ( unsigned char )( usRegHoldingBuf[iRegIndex] >> 8 );
-                    *pucRegBuffer++ = ( unsigned char )( usRegHoldingBuf[iRegIndex] & 0xFF );
-                    iRegIndex++;
-                    usNRegs--;
-                }
-                break;
-
-            case MB_REG_WRITE:
-                while( usNRegs > 0 )
-                {
-                    // usRegHoldingBuf[iRegIndex++] = __REV16(*PRT++); // Sequence data transfer REV16.W
-                    usRegHoldingBuf[iRegIndex] = *pucRegBuffer++ << 8;
-                    usRegHoldingBuf[iRegIndex] |= *pucRegBuffer++;
-                    iRegIndex++;
-                    usNRegs--;
-                }
+            SyncArmZeroCross = FrameZeroCross;
+        }
+    }
+    else if( ( usAddress >= REG_SPECTRUM_START ) && ( usAddress + usNRegs <= REG_SPECTRUM_START + SPECTRUM_NREGS ) )
+    {
+        iRegIndex = ( int )( usAddress - REG_SPECTRUM_START );
+        // Only the window configuration can be written, the cached values are read only
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex + usNRegs > SPECTRUM_DATA ) )
+        {
+            eStatus = MB_ENOREG;
+        }
+        else if( ( eMode == MB_REG_WRITE ) &&
+                 ( ( eStatus = prveMBSpectrumWindowCheck( pucRegBuffer, iRegIndex, usNRegs ) ) != MB_ENOERR ) )
+        {
+            // Nothing is written, the cache keeps the previous window
+        }
+        else
+        {
+            eStatus = prveMBRegBufferCB( usRegSpectrumBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
+        }
+    }
+    else if( ( usAddress >= REG_PROFILE_START ) && ( usAddress + usNRegs <= REG_PROFILE_START + PROFILE_NREGS ) )
+    {
+        iRegIndex = ( int )( usAddress - REG_PROFILE_START );
+        // Only the control register can be written, the cycle counts are read only
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex + usNRegs > PROFILE_NUM_STAGES ) )
+        {
+            eStatus = MB_ENOREG;
+        }
+        else
+        {
+            eStatus = prveMBRegBufferCB( usRegProfileBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
+        }
+    }
+    else if( ( usAddress >= REG_HEALTH_START ) && ( usAddress + usNRegs <= REG_HEALTH_START + HEALTH_NREGS ) )
+    {
+        iRegIndex = ( int )( usAddress - REG_HEALTH_START );
+        // Only the control register can be written, the counters are read only
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex + usNRegs > HEALTH_UART_OVERRUNS ) )
+        {
+            eStatus = MB_ENOREG;
+        }
+        else
+        {
+            eStatus = prveMBRegBufferCB( usRegHealthBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
+        }
+    }
+    else if( ( usAddress >= REG_SYSTEM_START ) && ( usAddress + usNRegs <= REG_SYSTEM_START + SYSTEM_NREGS ) )
+    {
+        iRegIndex = ( int )( usAddress - REG_SYSTEM_START );
+        // Only the control register can be written, the load and the memory map are read only
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex + usNRegs > SYSTEM_CPU_LOAD ) )
+        {
+            eStatus = MB_ENOREG;
+        }
+        else
+        {
+            eStatus = prveMBRegBufferCB( usRegSystemBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
+        }
+    }
+    else if( ( usAddress >= REG_TRACE_START ) && ( usAddress + usNRegs <= REG_TRACE_START + TRACE_NREGS ) )
+    {
+        iRegIndex = ( int )( usAddress - REG_TRACE_START );
+        // Only the control and the mask can be written, the ring is read only
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex + usNRegs > TRACE_HEAD ) )
+        {
+            eStatus = MB_ENOREG;
+        }
+        else
+        {
+            eStatus = prveMBRegBufferCB( usRegTraceBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
+        }
+    }
+    else if( ( usAddress >= REG_HISTORY_START ) && ( usAddress + usNRegs <= REG_HISTORY_START + HISTORY_NREGS ) )
+    {
+        iRegIndex = ( int )( usAddress - REG_HISTORY_START );
+        // Only the control and the decimation can be written, the window is read only
+        if( ( eMode == MB_REG_WRITE ) && ( iRegIndex + usNRegs > HISTORY_HEAD ) )
+        {
+            eStatus = MB_ENOREG;
+        }
+        else
+        {
+            eStatus = prveMBRegBufferCB( usRegHistoryBuf, pucRegBuffer, iRegIndex, usNRegs, eMode );
         }
     }
     else
@@ -132,3 +253,22 @@ eMBRegDiscreteCB( UCHAR * pucRegBuffer, USHORT usAddress, USHORT usNDiscrete )
     return MB_ENOREG;
 }
 
+
+// Read file record 0x14, raw samples of the last acquisition from the SRAM
+// File number 1..6 is the channel CH0..CH5, record number is the first sample
+// and record length is the number of samples, returned as int16 ADC values
+eMBErrorCode
+eMBFileRecordCB( UCHAR * pucRecordBuffer, USHORT usFileNumber, USHORT usRecordNumber, USHORT usRecordLength )
+{
+    if( ( usFileNumber < 1 ) || ( usFileNumber > SRAM_RECORD_CHANNELS ) ||
+        ( usRecordNumber >= SRAM_RECORD_SAMPLES ) ||
+        ( usRecordLength > SRAM_RECORD_SAMPLES - usRecordNumber ) )
+    {
+        return MB_ENOREG;
+    }
+
+    // Stream straight from the SRAM into the Modbus frame
+    read_Channel_From_SRAM( usFileNumber - 1, usRecordNumber, usRecordLength, pucRecordBuffer );
+
+    return MB_ENOERR;
+}
@@ -56,4 +56,13 @@ typedef int32_t LONG;
 #define FALSE           0
 #endif
 
+/* Event queue statistics, see portevent.c */
+extern volatile USHORT usMBPortEventOverflows;
+extern volatile USHORT usMBPortEventHighWater;
+
+/* Receive errors, see portevent.c and mbrtu.c */
+extern volatile USHORT usMBPortUARTOverruns;   /* Bytes lost by the USART (ORE) */
+extern volatile USHORT usMBRTUCRCErrors;       /* Frames too short or with a bad CRC */
+extern volatile USHORT usMBRTURxOverflows;     /* Frames longer than the buffer */
+
 #endif
@@ -19,27 +19,97 @@
  * File: $Id: portevent.c,v 1.1 2006/08/22 21:35:13 wolti Exp $
  */
 
+/* ----------------------- Platform includes --------------------------------*/
+#include "port.h"
+
 /* ----------------------- Modbus includes ----------------------------------*/
 #include "mb.h"
 #include "mbport.h"
 
+/* ----------------------- Board includes -----------------------------------*/
+#include "trace.h"
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_PORT_EVENT_QUEUE_SIZE    ( 8 )   /* Power of 2 */
+#define MB_PORT_EVENT_QUEUE_MASK    ( MB_PORT_EVENT_QUEUE_SIZE - 1 )
+
 /* ----------------------- Variables ----------------------------------------*/
-static eMBEventType eQueuedEvent;
-static BOOL     xEventInQueue;
+/* Events from the interrupts (T3.5 timer and USART, the same preemption
+ * priority, so they never nest) go into a single producer / single consumer
+ * ring, the consumer is eMBPoll( ). The head is only written by the producer
+ * and the tail only by the consumer. The one exception is the flag of a frame
+ * waiting in the ring: the producer sets it, and the consumer clears it with
+ * the tail advance, with the interrupts masked for those few instructions, so
+ * a frame received just after the previous one was taken is not dropped.
+ * Events posted by eMBPoll( ) itself (EV_EXECUTE) use a separate slot, which
+ * is served first, so they keep their order in front of the new frames. */
+static volatile eMBEventType eQueuedEvents[MB_PORT_EVENT_QUEUE_SIZE];
+static volatile UCHAR ucEventHead;
+static volatile UCHAR ucEventTail;
+static volatile BOOL xFrameReceivedInQueue;
+
+static eMBEventType eLocalEvent;
+static BOOL     xLocalEventInQueue;
+
+/* Dropped events (queue full, or a second frame received before the first
+ * one was read, the RTU has only one receive buffer) and queue high-water. */
+volatile USHORT usMBPortEventOverflows;
+volatile USHORT usMBPortEventHighWater;
+
+/* Bytes lost by the USART (overrun), counted in USART1_IRQHandler. */
+volatile USHORT usMBPortUARTOverruns;
 
 /* ----------------------- Start implementation -----------------------------*/
 BOOL
 xMBPortEventInit( void )
 {
-    xEventInQueue = FALSE;
+    ucEventHead = 0;
+    ucEventTail = 0;
+    xFrameReceivedInQueue = FALSE;
+    xLocalEventInQueue = FALSE;
     return TRUE;
 }
 
 BOOL
 xMBPortEventPost( eMBEventType eEvent )
 {
-    xEventInQueue = TRUE;
-    eQueuedEvent = eEvent;
+    UCHAR           ucUsed;
+
+    Trace( TRACE_MB_EVENT, eEvent );
+
+    /* Posted from eMBPoll( ), not from an interrupt. */
+    if( __get_IPSR(  ) == 0 )
+    {
+        eLocalEvent = eEvent;
+        xLocalEventInQueue = TRUE;
+        return TRUE;
+    }
+
+    if( eEvent == EV_FRAME_RECEIVED )
+    {
+        if( xFrameReceivedInQueue )
+        {
+            /* The frame in the queue was overwritten by this one, it is
+             * received (and answered) only once. */
+            usMBPortEventOverflows++;
+            return TRUE;
+        }
+        xFrameReceivedInQueue = TRUE;
+    }
+
+    ucUsed = ( UCHAR )( ucEventHead - ucEventTail ) & 0xFF;
+    if( ucUsed >= MB_PORT_EVENT_QUEUE_SIZE )
+    {
+        usMBPortEventOverflows++;
+        return FALSE;
+    }
+    eQueuedEvents[ucEventHead & MB_PORT_EVENT_QUEUE_MASK] = eEvent;
+    ucEventHead++;
+
+    if( ucUsed + 1 > usMBPortEventHighWater )
+    {
+        usMBPortEventHighWater = ucUsed + 1;
+    }
     return TRUE;
 }
 
@@ -48,16 +118,23 @@ xMBPortEventGet( eMBEventType * eEvent )
 {
     BOOL            xEventHappened = FALSE;
 
-    if( xEventInQueue )
+    if( xLocalEventInQueue )
     {
-        *eEvent = eQueuedEvent;
-        xEventInQueue = FALSE;
+        *eEvent = eLocalEvent;
+        xLocalEventInQueue = FALSE;
+        xEventHappened = TRUE;
+    }
+    else if( ucEventTail != ucEventHead )
+    {
+        ENTER_CRITICAL_SECTION(  );
+        *eEvent = eQueuedEvents[ucEventTail & MB_PORT_EVENT_QUEUE_MASK];
+        if( *eEvent == EV_FRAME_RECEIVED )
+        {
+            xFrameReceivedInQueue = FALSE;
+        }
+        ucEventTail++;
+        EXIT_CRITICAL_SECTION(  );
         xEventHappened = TRUE;
     }
     return xEventHappened;
 }
-
-
-
-
-
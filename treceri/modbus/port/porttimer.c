@@ -26,6 +26,7 @@
 #include "mb.h"
 #include "mbport.h"
 #include "stm32f10x.h"
+#include "main.h"
 
 /* ----------------------- Start implementation -----------------------------*/
 BOOL
@@ -89,6 +90,8 @@ void vMBPortTimersDisable(  ) //
  */
 void prvvTIMERExpiredISR( void ) //ʱжڵ
 {
+    // End of a frame, remember the zero-cross counter for the synchronized capture
+    FrameZeroCross = ZeroCrossCount;
     ( void )pxMBPortCBTimerExpired(  );
 }
 
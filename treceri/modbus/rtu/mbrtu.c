@@ -76,6 +76,10 @@ static volatile USHORT usSndBufferCount;
 
 static volatile USHORT usRcvBufferPos;
 
+/* Receive errors, read by the application (port.h) */
+volatile USHORT usMBRTUCRCErrors;
+volatile USHORT usMBRTURxOverflows;
+
 /* ----------------------- Start implementation -----------------------------*/
 eMBErrorCode
 eMBRTUInit( UCHAR ucSlaveAddress, UCHAR ucPort, ULONG ulBaudRate, eMBParity eParity )
@@ -177,6 +181,10 @@ eMBRTUReceive( UCHAR * pucRcvAddress, UCHAR ** pucFrame, USHORT * pusLength )
     else
     {
         eStatus = MB_EIO;
+        if( usMBRTUCRCErrors < 0xFFFF )
+        {
+            usMBRTUCRCErrors++;
+        }
     }
 
     EXIT_CRITICAL_SECTION(  );
@@ -275,6 +283,10 @@ xMBRTUReceiveFSM( void )
         else
         {
             eRcvState = STATE_RX_ERROR;
+            if( usMBRTURxOverflows < 0xFFFF )
+            {
+                usMBRTURxOverflows++;
+            }
         }
         vMBPortTimersEnable(  );
         break;
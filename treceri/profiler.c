@@ -0,0 +1,62 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include "profiler.h"
+
+uint32_t prof_start[PROFILE_STAGES];
+static uint32_t prof_min[PROFILE_STAGES];
+static uint32_t prof_max[PROFILE_STAGES];
+
+static void prof_put(uint8_t index, uint32_t value) {
+    usRegProfileBuf[index] = value >> 16;
+    usRegProfileBuf[index + 1] = value & 0xFFFF;
+}
+
+void Prof_End(uint8_t stage) {
+    uint32_t cycles = PROF_NOW() - prof_start[stage];
+    uint8_t index = PROFILE_DATA + 6 * stage;
+
+    prof_put(index, cycles);
+    if (cycles < prof_min[stage]) {
+        prof_min[stage] = cycles;
+        prof_put(index + 2, cycles);
+    }
+    if (cycles > prof_max[stage]) {
+        prof_max[stage] = cycles;
+        prof_put(index + 4, cycles);
+    }
+}
+
+void Prof_Init(void) {
+    uint8_t i;
+
+    for (i = 0; i < PROFILE_NREGS; i++)
+        usRegProfileBuf[i] = 0;
+    usRegProfileBuf[PROFILE_NUM_STAGES] = PROFILE_STAGES;
+    usRegProfileBuf[PROFILE_CLOCK_MHZ] = 72;
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        // Min shows 0 until the stage runs once
+        prof_min[i] = 0xFFFFFFFF;
+        prof_max[i] = 0;
+    }
+}
+
+void Prof_Poll(void) {
+    if (usRegProfileBuf[PROFILE_CONTROL] == 0)
+        return;
+    Prof_Init();
+}
@@ -0,0 +1,60 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Cycle profiler of the main loop stages, with the DWT cycle counter.
+ *
+ * Prof_Begin() / Prof_End() around a stage keep the last, min and max
+ * cycles of it in usRegProfileBuf, so the master can read where the
+ * time of a measurement cycle goes (72 cycles = 1 us). A probe costs
+ * a few cycles, the DWT counter runs free (the capture does not reset it).
+ * The stages that run once per channel (SRAM load, window, FFT, phase)
+ * are counted per channel.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include "main.h"
+#include "hal.h"
+
+#define PROF_ZC_WAIT      0  // Wait for the zero-cross (or the synchronized one)
+#define PROF_CAPTURE      1  // 2048 samples from the MCP3903 to the SRAM
+#define PROF_SRAM_LOAD    2  // One channel from the SRAM to the FFT buffer, min and max
+#define PROF_WINDOW       3
+#define PROF_FFT          4
+#define PROF_PHASE        5
+#define PROF_PUBLISH      6  // RMS, phase correction, result registers
+#define PROF_CYCLE        7  // A whole measurement cycle, from step 0 to the published results
+#define PROF_MODBUS       8  // eMBPoll(), with the reply
+
+#define PROF_NOW()        (*(volatile uint32_t *)HAL_DWT_CYCCNT)
+
+extern uint32_t prof_start[PROFILE_STAGES];
+
+static inline void Prof_Begin(uint8_t stage) {
+    prof_start[stage] = PROF_NOW();
+}
+
+void Prof_End(uint8_t stage);
+// Header registers, min and max reset
+void Prof_Init(void);
+// PROFILE_CONTROL written by the master, from the main loop
+void Prof_Poll(void);
+
+#endif
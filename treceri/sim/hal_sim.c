@@ -0,0 +1,510 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Virtual peripherals of the treceri board, see hal_sim.h.
+ *
+ *   SysTick     1 ms, TimingDelay and TickCount like stm32f10x_it.c
+ *   PB11        zero-cross input, high for the first half of each mains period,
+ *               EXTI11 on the rising edge (ZeroCrossCount, ZeroCrossDWT)
+ *   PA2         MCP3903 /DRA, low for 64 cycles at the start of each sample
+ *               (6144 cycles, 11718.75 Hz)
+ *   SPI1 + PA4  MCP3903, a read command returns the 6 channels of the last sample
+ *   SPI1 + PA3  23K256, 32 KB with READ / WRITE / RDSR / WRSR, sequential mode
+ *   USART1      19200 baud on a pty, one byte every 10 bit times
+ *   TIM4        Modbus T3.5 timer, 50 us ticks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include "stm32f10x.h"
+#include "main.h"
+#include "hal.h"
+#include "sysmon.h"
+#include "trace.h"
+#include "dsp_core.h"
+
+// Modbus port interrupts, port_sim.c
+void prvvUARTTxReadyISR(void);
+void prvvUARTRxISR(void);
+void prvvTIMERExpiredISR(void);
+
+extern volatile uint32_t TimingDelay;
+extern volatile uint32_t TickCount;
+
+#define SYSTICK_CYCLES      72000ULL   // 1 ms
+#define SAMPLE_CYCLES       6144ULL    // MCP3903 data rate, 11718.75 Hz
+#define DRA_LOW_CYCLES      64ULL
+
+// Cost of the accesses, in CPU cycles
+#define COST_SPI_BYTE       80   // 8 bits at 9 MHz (prescaler 8) and the register accesses
+#define COST_PIN_READ       8
+#define COST_IDLE           200
+#define FLASH_ERASE_CYCLES  1440000ULL  // 20 ms page erase
+
+#define SRAM_SIZE           32768
+
+// 23K256 instructions
+#define RAM_READ            3
+#define RAM_WRITE           2
+#define RAM_RDSR            5
+#define RAM_WRSR            1
+
+sim_config_t sim_config = {
+    50.0,
+    { 0.1, 0.1, 0.1, 0.1, 0.1, 0.1 },
+    { 0.0, 60.0, 120.0, 180.0, 240.0, 300.0 },
+    0.0, 0.0, 0.0, 0, -1, SIM_FAULT_NONE
+};
+
+GPIO_TypeDef sim_gpio[3];
+
+volatile uint32_t sim_dwt_control;
+volatile uint32_t sim_dwt_cyccnt;
+volatile uint32_t sim_scb_demcr;
+
+static uint64_t now;            // Virtual time, CPU cycles
+static int in_isr;
+static uint64_t next_systick = SYSTICK_CYCLES;
+static uint64_t next_zero_cross;
+static uint32_t zero_cross_index;
+
+static struct timespec host_start;
+static struct timespec host_last;  // Left the simulator, for cpu_scale
+
+/* ----------------------- Statistics ---------------------------------------*/
+static unsigned long captures;
+static unsigned long spi_bytes;
+static unsigned long rx_bytes;
+static unsigned long tx_bytes;
+
+/* ----------------------- USART and T3.5 timer -----------------------------*/
+#define RX_FIFO_SIZE        1024
+
+static uint64_t byte_cycles = 37500;  // 10 bits at 19200 baud
+static int rx_enabled, tx_enabled;
+static uint8_t rx_fifo[RX_FIFO_SIZE];
+static unsigned rx_head, rx_tail;
+static uint64_t next_rx;
+static uint8_t rx_data;
+static uint64_t tx_free;  // The transmit register is empty from here
+
+static int timer_enabled;
+static uint64_t timer_period;
+static uint64_t timer_deadline;
+
+/* ----------------------- SPI devices --------------------------------------*/
+static int adc_selected, ram_selected;
+static unsigned adc_byte;         // Bytes since chip select
+static uint8_t adc_read;          // The transaction is a read
+static uint8_t adc_latch[12];     // 6 channels, MSB first
+
+static uint8_t sram[SRAM_SIZE];
+static unsigned ram_byte;
+static uint8_t ram_command;
+static uint16_t ram_address;
+static uint8_t ram_status;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+uint16_t sim_cal_page[512];
+
+static double host_seconds(const struct timespec *from) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - from->tv_sec) + (t.tv_nsec - from->tv_nsec) / 1e9;
+}
+
+// xorshift64*, uniform in [-1, 1)
+static double rng_uniform(void) {
+    uint64_t x = rng_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng_state = x;
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / 4503599627370496.0 - 1.0;
+}
+
+static uint64_t zero_cross_time(uint32_t k) {
+    return (uint64_t)llround(k * SIM_CPU_HZ / sim_config.frequency);
+}
+
+/* ----------------------- Events -------------------------------------------*/
+static void poll_pty(void) {
+    uint8_t buf[256];
+    ssize_t n;
+
+    if (sim_config.pty_fd < 0)
+        return;
+    while ((n = read(sim_config.pty_fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (((rx_head + 1) % RX_FIFO_SIZE) == rx_tail)
+                break;  // Overrun, the byte is lost like on the USART
+            rx_fifo[rx_head] = buf[i];
+            rx_head = (rx_head + 1) % RX_FIFO_SIZE;
+        }
+    }
+}
+
+static void systick(void) {
+    if (TimingDelay != 0x00) TimingDelay--;
+    TickCount++;
+    SysMon_Tick();
+    poll_pty();
+
+    // Keep the virtual time with the wall clock
+    if (sim_config.realtime) {
+        double ahead = now / SIM_CPU_HZ - host_seconds(&host_start);
+        if (ahead > 0.001)
+            usleep((useconds_t)(ahead * 1e6));
+    }
+    if (sim_config.stop_seconds > 0 && now >= sim_config.stop_seconds * SIM_CPU_HZ) {
+        exit(sim_report());
+    }
+}
+
+static void zero_cross(void) {
+    if (sim_config.fault != SIM_FAULT_ZC) {
+        ZeroCrossDWT = sim_dwt_cyccnt;
+        ZeroCrossCount++;
+        Trace(TRACE_ZERO_CROSS, ZeroCrossCount);
+    }
+    next_zero_cross = zero_cross_time(++zero_cross_index);
+}
+
+// Next event time, ~0 if none
+static uint64_t rx_time(void) {
+    if (!rx_enabled || rx_head == rx_tail)
+        return ~0ULL;
+    return next_rx > now ? next_rx : now;
+}
+
+static uint64_t tx_time(void) {
+    if (!tx_enabled)
+        return ~0ULL;
+    return tx_free > now ? tx_free : now;
+}
+
+static uint64_t timer_time(void) {
+    return timer_enabled ? timer_deadline : ~0ULL;
+}
+
+// Let `cycles` of CPU time pass, and run the interrupts that come in this time
+static void sim_advance(uint64_t cycles) {
+    uint64_t target = now + cycles;
+
+    if (sim_config.cpu_scale > 0.0) {
+        // The computation since the last access, on the target
+        target += (uint64_t)(host_seconds(&host_last) * sim_config.cpu_scale * SIM_CPU_HZ);
+    }
+
+    in_isr = 1;
+    for (;;) {
+        uint64_t t = next_systick;
+        int event = 0;
+
+        if (next_zero_cross < t) { t = next_zero_cross; event = 1; }
+        if (timer_time() < t) { t = timer_time(); event = 2; }
+        if (rx_time() < t) { t = rx_time(); event = 3; }
+        if (tx_time() < t) { t = tx_time(); event = 4; }
+        if (t > target)
+            break;
+
+        if (sim_dwt_control & 1)
+            sim_dwt_cyccnt += (uint32_t)(t - now);
+        now = t;
+
+        switch (event) {
+            case 0:
+                next_systick += SYSTICK_CYCLES;
+                systick();
+                break;
+            case 1:
+                zero_cross();
+                break;
+            case 2:
+                timer_deadline += timer_period;
+                prvvTIMERExpiredISR();
+                break;
+            case 3:
+                rx_data = rx_fifo[rx_tail];
+                rx_tail = (rx_tail + 1) % RX_FIFO_SIZE;
+                next_rx = now + byte_cycles;
+                rx_bytes++;
+                prvvUARTRxISR();
+                break;
+            case 4:
+                // Without a new byte the TXE interrupt would come again at once
+                tx_free = now + byte_cycles;
+                prvvUARTTxReadyISR();
+                break;
+        }
+    }
+    in_isr = 0;
+
+    if (sim_dwt_control & 1)
+        sim_dwt_cyccnt += (uint32_t)(target - now);
+    now = target;
+
+    if (sim_config.cpu_scale > 0.0)
+        clock_gettime(CLOCK_MONOTONIC, &host_last);
+}
+
+/* ----------------------- Pins ---------------------------------------------*/
+int sim_zero_cross_high(void) {
+    uint64_t start;
+
+    sim_advance(COST_PIN_READ);
+    if (sim_config.fault == SIM_FAULT_ZC)
+        return 0;
+    // High for the first half of the period that started at the last rising edge
+    start = zero_cross_time(zero_cross_index - 1);
+    return (now - start) < (uint64_t)(SIM_CPU_HZ / sim_config.frequency / 2.0);
+}
+
+int sim_dra_high(void) {
+    sim_advance(COST_PIN_READ);
+    if (sim_config.fault == SIM_FAULT_DRA)
+        return 1;
+    return (now % SAMPLE_CYCLES) >= DRA_LOW_CYCLES;
+}
+
+void sim_idle(void) {
+    sim_advance(COST_IDLE);
+}
+
+uint32_t __get_IPSR(void) {
+    return in_isr ? 15 : 0;
+}
+
+void __set_PRIMASK(uint32_t priMask) {
+    (void)priMask;
+}
+
+/* ----------------------- MCP3903 and 23K256 -------------------------------*/
+// The 6 channels of sample n, as the MCP3903 gives them
+static void adc_sample(uint64_t n) {
+    double t = (double)(n * SAMPLE_CYCLES) / SIM_CPU_HZ;
+
+    for (int ch = 0; ch < SIM_CHANNELS; ch++) {
+        double v = sim_config.amplitude[ch] * sqrt(2.0) *
+                   sin(2.0 * PI * sim_config.frequency * t + sim_config.phase[ch] * DEG2RAD);
+        double code;
+        int16_t c;
+
+        v += sim_config.noise * rng_uniform();
+        code = nearbyint(v / 2.39 * 3.0 * 32767.0);
+        c = (int16_t)(code > 32767 ? 32767 : (code < -32768 ? -32768 : code));
+        adc_latch[2 * ch] = (uint8_t)((uint16_t)c >> 8);
+        adc_latch[2 * ch + 1] = (uint8_t)c;
+    }
+}
+
+static uint8_t adc_transfer(uint8_t data) {
+    uint8_t out = 0;
+
+    if (adc_byte == 0) {
+        // Control byte, bit 0 set for a read. The read starts at the
+        // last finished conversion, the one that pulled /DRA low.
+        adc_read = data & 1;
+        if (adc_read)
+            adc_sample(now / SAMPLE_CYCLES);
+    } else if (adc_read && adc_byte <= sizeof(adc_latch)) {
+        out = adc_latch[adc_byte - 1];
+    }
+    adc_byte++;
+    return out;
+}
+
+static uint8_t ram_transfer(uint8_t data) {
+    uint8_t out = 0;
+
+    if (ram_byte == 0) {
+        ram_command = data;
+    } else if (ram_command == RAM_RDSR) {
+        out = ram_status;
+    } else if (ram_command == RAM_WRSR) {
+        if (ram_byte == 1)
+            ram_status = data;
+    } else if (ram_command == RAM_READ || ram_command == RAM_WRITE) {
+        if (ram_byte == 1) {
+            ram_address = (uint16_t)(data << 8);
+        } else if (ram_byte == 2) {
+            ram_address |= data;
+            if (ram_command == RAM_WRITE && ram_address == 0)
+                captures++;
+        } else {
+            if (ram_command == RAM_READ)
+                out = sram[ram_address];
+            else
+                sram[ram_address] = data;
+            ram_address = (ram_address + 1) % SRAM_SIZE;
+        }
+    }
+    ram_byte++;
+    return out;
+}
+
+uint8_t SPISend(uint8_t data) {
+    uint8_t out = 0xFF;
+
+    sim_advance(COST_SPI_BYTE);
+    spi_bytes++;
+    if (adc_selected)
+        out = adc_transfer(data);
+    else if (ram_selected)
+        out = ram_transfer(data);
+    return out;
+}
+
+// Chip selects, PA4 the MCP3903 and PA3 the 23K256
+static void chip_select(void) {
+    int adc = (GPIOA->ODR & GPIO_Pin_4) == 0;
+    int ram = (GPIOA->ODR & GPIO_Pin_3) == 0;
+
+    if (adc && !adc_selected)
+        adc_byte = 0;
+    if (ram && !ram_selected)
+        ram_byte = 0;
+    adc_selected = adc;
+    ram_selected = ram;
+}
+
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+    GPIOx->ODR |= GPIO_Pin;
+    if (GPIOx == GPIOA)
+        chip_select();
+}
+
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+    if (GPIOx == GPIOA)
+        chip_select();
+}
+
+/* ----------------------- Board --------------------------------------------*/
+void Board_Init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &host_start);
+    host_last = host_start;
+    // Both chip selects high, no device selected
+    GPIOA->ODR = GPIO_Pin_3 | GPIO_Pin_4;
+    chip_select();
+    zero_cross_index = 1;
+    next_zero_cross = zero_cross_time(zero_cross_index);
+    // Erased flash, no calibration
+    memset(sim_cal_page, 0xFF, sizeof(sim_cal_page));
+}
+
+void ZeroCross_Init(void) {
+}
+
+void SPI_init(void) {
+}
+
+// The flash erase stalls the board for about 20 ms
+int Flash_WriteCalPage(const uint16_t *data, uint16_t count) {
+    memset(sim_cal_page, 0xFF, sizeof(sim_cal_page));
+    memcpy(sim_cal_page, data, count * sizeof(uint16_t));
+    sim_advance(FLASH_ERASE_CYCLES);
+    return 0;
+}
+
+/* ----------------------- Modbus port --------------------------------------*/
+void sim_uart_init(uint32_t baud_rate) {
+    byte_cycles = (uint64_t)(10.0 * SIM_CPU_HZ / baud_rate);
+}
+
+void sim_uart_enable(int rx_enable, int tx_enable) {
+    rx_enabled = rx_enable;
+    tx_enabled = tx_enable;
+}
+
+void sim_uart_put(uint8_t byte) {
+    tx_bytes++;
+    tx_free = now + byte_cycles;
+    if (sim_config.pty_fd >= 0) {
+        while (write(sim_config.pty_fd, &byte, 1) < 0 && errno == EAGAIN)
+            usleep(100);
+    }
+}
+
+uint8_t sim_uart_get(void) {
+    return rx_data;
+}
+
+void sim_timer_init(uint16_t timeout_50us) {
+    timer_period = (uint64_t)timeout_50us * (uint64_t)(SIM_CPU_HZ / 20000.0);
+}
+
+void sim_timer_enable(int enable) {
+    timer_enabled = enable;
+    timer_deadline = now + timer_period;
+}
+
+/* ----------------------- Report -------------------------------------------*/
+int sim_report(void) {
+    int failed = 0;
+
+    double virtual_seconds = now / SIM_CPU_HZ;
+    double host = host_seconds(&host_start);
+
+    printf("virtual time: %.3f s, host time: %.3f s (%.1fx)\n", virtual_seconds, host,
+           host > 0 ? virtual_seconds / host : 0.0);
+    printf("captures: %lu, zero-crosses: %u, SPI bytes: %lu, Modbus rx/tx bytes: %lu/%lu\n",
+           captures, (unsigned)ZeroCrossCount, spi_bytes, rx_bytes, tx_bytes);
+    printf("registers 1..20:");
+    for (int i = 1; i <= 20; i++)
+        printf(" %u", usRegHoldingBuf[i]);
+    printf("\n");
+    printf("health: zero-cross timeouts %u, /DRA timeouts %u, failed captures %u, "
+           "good captures %u, last capture %u ms\n", usRegHealthBuf[HEALTH_ZC_TIMEOUTS],
+           usRegHealthBuf[HEALTH_DRA_TIMEOUTS], usRegHealthBuf[HEALTH_FAILED_CAPTURES],
+           usRegHealthBuf[HEALTH_CAPTURES], usRegHealthBuf[HEALTH_CAPTURE_MS]);
+    printf("cpu load: %.1f %%, peak %.1f %%\n", usRegSystemBuf[SYSTEM_CPU_LOAD] / 10.0,
+           usRegSystemBuf[SYSTEM_CPU_LOAD_MAX] / 10.0);
+    printf("history: %u results in the window, CH0 phase mean %.2f std %.2f rate %.2f / min\n",
+           usRegHistoryBuf[HISTORY_USED], usRegHistoryBuf[HISTORY_STATS + HISTORY_STAT_PHASE_MEAN] / 100.0,
+           usRegHistoryBuf[HISTORY_STATS + HISTORY_STAT_PHASE_STD] / 100.0,
+           (int16_t)usRegHistoryBuf[HISTORY_STATS + HISTORY_STAT_PHASE_RATE] / 100.0);
+    if (usRegHoldingBuf[REG_RESULT_READY] == 0) {
+        printf("no results published\n");
+        return 0;
+    }
+    printf("results published\n");
+    printf("%-4s %10s %10s %10s %10s %10s\n", "ch", "rms_model", "rms", "phase_model", "phase", "error");
+    for (int ch = 0; ch < SIM_CHANNELS; ch++) {
+        double phase = usRegHoldingBuf[7 + ch] / 100.0;
+        double error = fmod(phase - sim_config.phase[ch], 360.0);
+        if (error > 180.0) error -= 360.0;
+        if (error < -180.0) error += 360.0;
+        printf("CH%-2d %10.4f %10.4f %10.2f %10.2f %10.2f\n", ch, sim_config.amplitude[ch],
+               usRegHoldingBuf[1 + ch] / 10000.0, sim_config.phase[ch], phase, error);
+        if (sim_config.amplitude[ch] >= SIM_RMS_MIN &&
+            (fabs(error) > SIM_PHASE_TOLERANCE ||
+             fabs(usRegHoldingBuf[1 + ch] / 10000.0 - sim_config.amplitude[ch]) >
+                 SIM_RMS_TOLERANCE * sim_config.amplitude[ch]))
+            failed = 1;
+    }
+    printf("model check: %s (phase within %.2f degrees, RMS within %.0f %%)\n",
+           failed ? "FAIL" : "PASS", SIM_PHASE_TOLERANCE, SIM_RMS_TOLERANCE * 100.0);
+    return failed;
+}
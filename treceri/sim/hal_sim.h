@@ -0,0 +1,104 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Linux simulator of the treceri board, used through hal.h with HAL_SIM.
+ *
+ * The time is virtual, in CPU cycles of the 72 MHz core. It only moves when
+ * the firmware touches a peripheral (pin read, SPI byte, HAL_IDLE), by what
+ * that access costs on the board. The "interrupts" (SysTick, EXTI11 of the
+ * zero-cross, USART1 and the Modbus T3.5 timer) run from there, at their
+ * exact virtual time. The computation itself takes no virtual time, unless
+ * cpu_scale is set (host time x cpu_scale).
+ */
+
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <stdint.h>
+
+#define SIM_CPU_HZ        72000000.0
+#define SIM_CHANNELS      6
+
+typedef struct {
+    double frequency;                 // Mains frequency, Hz
+    double amplitude[SIM_CHANNELS];   // Volts RMS on the 5.6 ohm resistor
+    double phase[SIM_CHANNELS];       // Degrees from the zero-cross rising edge
+    double noise;                     // Uniform noise, peak volts
+    double stop_seconds;              // Virtual seconds to run, 0 = forever
+    double cpu_scale;                 // Target cycles per host cycle for the computation
+    int realtime;                     // Keep the virtual time with the wall clock
+    int pty_fd;                       // Modbus pty master, -1 = no Modbus link
+    int fault;                        // SIM_FAULT_...
+} sim_config_t;
+
+#define SIM_FAULT_NONE    0
+#define SIM_FAULT_ZC      1           // No zero-cross, the input stays low
+#define SIM_FAULT_DRA     2           // /DRA stuck high, the MCP3903 does not run
+
+extern sim_config_t sim_config;
+
+// DWT registers, counted in virtual cycles
+extern volatile uint32_t sim_dwt_control;
+extern volatile uint32_t sim_dwt_cyccnt;
+extern volatile uint32_t sim_scb_demcr;
+
+#define HAL_DWT_CONTROL       (&sim_dwt_control)
+#define HAL_DWT_CYCCNT        (&sim_dwt_cyccnt)
+#define HAL_SCB_DEMCR         (&sim_scb_demcr)
+
+#define HAL_ZERO_CROSS_HIGH   (sim_zero_cross_high())
+#define HAL_DRA_HIGH          (sim_dra_high())
+#define HAL_IDLE()            sim_idle()
+#define HAL_RAMFUNC
+
+// The calibration flash page, in RAM (erased at start)
+extern uint16_t sim_cal_page[512];
+#define HAL_CAL_DATA          ((const uint16_t *)sim_cal_page)
+
+// No memory map on the PC, the system monitor publishes 0
+#define HAL_RAM_SIZE          (20 * 1024)
+#define HAL_FLASH_SIZE        0xBC00
+#define HAL_STACK_BOTTOM      ((uint32_t *)0)
+#define HAL_STACK_SIZE        0
+#define HAL_DATA_SIZE         0
+#define HAL_BSS_SIZE          0
+#define HAL_RAMFUNC_SIZE      0
+#define HAL_FLASH_USED        0
+
+int sim_zero_cross_high(void);
+int sim_dra_high(void);
+void sim_idle(void);
+
+// Used by the Modbus port of the simulator (port_sim.c)
+void sim_uart_init(uint32_t baud_rate);
+void sim_uart_enable(int rx_enable, int tx_enable);
+void sim_uart_put(uint8_t byte);
+uint8_t sim_uart_get(void);
+void sim_timer_init(uint16_t timeout_50us);
+void sim_timer_enable(int enable);
+
+// Published results against the model, checked by sim_report()
+#define SIM_PHASE_TOLERANCE 0.1       // Degrees
+#define SIM_RMS_TOLERANCE   0.01      // Of the model RMS
+#define SIM_RMS_MIN         0.02      // Volts, the firmware publishes 0 under 0.015 V
+
+// Print the statistics and the published results, 1 when a channel is out of
+// the tolerances above, else 0 (also when nothing was published)
+int sim_report(void);
+
+#endif
@@ -0,0 +1,73 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Stand-in for the CMSIS / StdPeriph stm32f10x.h in the Linux simulator build.
+ * Only what main.c and the Modbus stack use outside of the board init:
+ * the integer types, the GPIO registers (plain memory here) and the CS pins,
+ * which go to the virtual SPI devices of hal_sim.c.
+ */
+
+#ifndef __STM32F10x_H
+#define __STM32F10x_H
+
+#include <stdint.h>
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+
+typedef struct {
+    volatile uint32_t CRL;
+    volatile uint32_t CRH;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+    volatile uint32_t BRR;
+    volatile uint32_t LCKR;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef sim_gpio[3];
+#define GPIOA  (&sim_gpio[0])
+#define GPIOB  (&sim_gpio[1])
+#define GPIOC  (&sim_gpio[2])
+
+#define GPIO_Pin_0    ((uint16_t)0x0001)
+#define GPIO_Pin_1    ((uint16_t)0x0002)
+#define GPIO_Pin_2    ((uint16_t)0x0004)
+#define GPIO_Pin_3    ((uint16_t)0x0008)
+#define GPIO_Pin_4    ((uint16_t)0x0010)
+#define GPIO_Pin_5    ((uint16_t)0x0020)
+#define GPIO_Pin_6    ((uint16_t)0x0040)
+#define GPIO_Pin_7    ((uint16_t)0x0080)
+#define GPIO_Pin_8    ((uint16_t)0x0100)
+#define GPIO_Pin_9    ((uint16_t)0x0200)
+#define GPIO_Pin_10   ((uint16_t)0x0400)
+#define GPIO_Pin_11   ((uint16_t)0x0800)
+#define GPIO_Pin_12   ((uint16_t)0x1000)
+#define GPIO_Pin_13   ((uint16_t)0x2000)
+#define GPIO_Pin_14   ((uint16_t)0x4000)
+#define GPIO_Pin_15   ((uint16_t)0x8000)
+
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void GPIO_ResetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+// Interrupts are only run by the simulator, between two accesses to a peripheral
+uint32_t __get_IPSR(void);
+void __set_PRIMASK(uint32_t priMask);
+
+#endif
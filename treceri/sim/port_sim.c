@@ -0,0 +1,106 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Modbus serial and T3.5 timer port of the simulator, in place of
+ * portserial.c and porttimer.c. The interrupt functions are the same,
+ * hal_sim.c calls them at the virtual time of the USART or TIM4 event.
+ */
+
+#include "port.h"
+#include "mb.h"
+#include "mbport.h"
+#include "main.h"
+#include "hal.h"
+
+/* ----------------------- Serial -------------------------------------------*/
+void
+vMBPortSerialEnable( BOOL xRxEnable, BOOL xTxEnable )
+{
+    sim_uart_enable( xRxEnable, xTxEnable );
+}
+
+BOOL
+xMBPortSerialInit( UCHAR ucPORT, ULONG ulBaudRate, UCHAR ucDataBits, eMBParity eParity )
+{
+    ( void )ucPORT;
+    ( void )ucDataBits;
+    ( void )eParity;
+    sim_uart_init( ulBaudRate );
+    return TRUE;
+}
+
+BOOL
+xMBPortSerialPutByte( CHAR ucByte )
+{
+    sim_uart_put( ( uint8_t )ucByte );
+    return TRUE;
+}
+
+BOOL
+xMBPortSerialGetByte( CHAR * pucByte )
+{
+    *pucByte = ( CHAR )sim_uart_get(  );
+    return TRUE;
+}
+
+void prvvUARTTxReadyISR( void )
+{
+    pxMBFrameCBTransmitterEmpty(  );
+}
+
+void prvvUARTRxISR( void )
+{
+    pxMBFrameCBByteReceived(  );
+}
+
+void
+vMBPortClose( void )
+{
+}
+
+/* ----------------------- Timer --------------------------------------------*/
+BOOL
+xMBPortTimersInit( USHORT usTim1Timerout50us )
+{
+    sim_timer_init( usTim1Timerout50us );
+    sim_timer_enable( 0 );
+    return TRUE;
+}
+
+void vMBPortTimersEnable(  )
+{
+    sim_timer_enable( 1 );
+}
+
+void vMBPortTimersDisable(  )
+{
+    sim_timer_enable( 0 );
+}
+
+void
+vMBPortTimersDelay( USHORT usTimeOutMS )
+{
+    ( void )usTimeOutMS;
+}
+
+void prvvTIMERExpiredISR( void )
+{
+    // End of a frame, remember the zero-cross counter for the synchronized capture
+    FrameZeroCross = ZeroCrossCount;
+    ( void )pxMBPortCBTimerExpired(  );
+}
@@ -0,0 +1,136 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Runs the treceri firmware (main.c, FreeModbus, DSP core) on Linux, against
+    the virtual peripherals of hal_sim.c.
+
+    Usage: treceri_sim [options]
+        --freq HZ          mains frequency (default 50)
+        --amp A0,A1,..     volts RMS on the 5.6 ohm resistors (default 0.1 for all)
+        --phase P0,P1,..   degrees from the zero-cross (default 0,60,120,180,240,300)
+        --noise V          uniform noise, peak volts (default 0)
+        --period MS        REG_MEAS_PERIOD at start, 0 = one step after each reply (default 0)
+        --seconds S        stop after S virtual seconds and print a report, the exit
+                           code is 1 when a published phase or RMS is out of the
+                           tolerances of hal_sim.h (0.1 degrees, 1 %)
+        --cpu-scale X      one host second of computation takes X seconds on the board
+        --realtime         keep the virtual time with the wall clock
+        --no-pty           no Modbus link
+        --fault zc|dra     no zero-cross edges, or /DRA stuck high
+
+    The Modbus RTU slave (address 8, 19200 baud) is on a pseudo terminal, its
+    path is printed at start, any Modbus master can open it like a serial port.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "main.h"
+#include "hal.h"
+
+int treceri_main(void);
+
+// Comma separated list of up to SIM_CHANNELS values, the last one fills the rest
+static void parse_list(const char *text, double *values) {
+    char *end;
+    int i = 0;
+
+    while (i < SIM_CHANNELS) {
+        values[i++] = strtod(text, &end);
+        if (*end != ',')
+            break;
+        text = end + 1;
+    }
+    while (i < SIM_CHANNELS) {
+        values[i] = values[i - 1];
+        i++;
+    }
+}
+
+static int open_pty(void) {
+    struct termios tio;
+    int master, slave;
+    const char *name;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || (name = ptsname(master)) == NULL) {
+        perror("pty");
+        return -1;
+    }
+    // Keep the slave open, else the master reads EIO until a client opens it
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if (slave >= 0 && tcgetattr(slave, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    printf("Modbus RTU on %s\n", name);
+    fflush(stdout);
+    return master;
+}
+
+int main(int argc, char *argv[]) {
+    int use_pty = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--freq") && i + 1 < argc) {
+            sim_config.frequency = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--amp") && i + 1 < argc) {
+            parse_list(argv[++i], sim_config.amplitude);
+        } else if (!strcmp(argv[i], "--phase") && i + 1 < argc) {
+            parse_list(argv[++i], sim_config.phase);
+        } else if (!strcmp(argv[i], "--noise") && i + 1 < argc) {
+            sim_config.noise = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--period") && i + 1 < argc) {
+            usRegHoldingBuf[REG_MEAS_PERIOD] = (u16)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            sim_config.stop_seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--cpu-scale") && i + 1 < argc) {
+            sim_config.cpu_scale = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--realtime")) {
+            sim_config.realtime = 1;
+        } else if (!strcmp(argv[i], "--fault") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "zc"))
+                sim_config.fault = SIM_FAULT_ZC;
+            else if (!strcmp(argv[i], "dra"))
+                sim_config.fault = SIM_FAULT_DRA;
+        } else if (!strcmp(argv[i], "--no-pty")) {
+            use_pty = 0;
+        } else {
+            fprintf(stderr, "Usage: %s [--freq HZ] [--amp A0,..] [--phase P0,..] [--noise V] [--period MS]\n"
+                            "       [--seconds S] [--cpu-scale X] [--realtime] [--no-pty] [--fault zc|dra]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (sim_config.frequency < 1.0)
+        sim_config.frequency = 50.0;
+
+    if (use_pty) {
+        sim_config.pty_fd = open_pty();
+        if (sim_config.pty_fd < 0)
+            return 1;
+    }
+    return treceri_main();
+}
@@ -22,6 +22,8 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f10x_it.h"
+#include "hal.h"
+#include "trace.h"
 
 /** @addtogroup STM32F10x_StdPeriph_Template
   * @{
@@ -33,6 +35,12 @@
 /* Private variables ---------------------------------------------------------*/
 
 extern volatile uint32_t TimingDelay;
+extern volatile uint32_t TickCount;
+extern volatile uint32_t ZeroCrossCount;
+extern volatile uint32_t ZeroCrossDWT;
+extern volatile uint32_t *DWT_CYCCNT;
+extern volatile unsigned short usMBPortUARTOverruns;
+extern void SysMon_Tick(void);
 
 /* Private function prototypes -----------------------------------------------*/
 
@@ -143,6 +151,8 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
     if (TimingDelay != 0x00) TimingDelay--;	
+    TickCount++;
+    SysMon_Tick();
 }
 
 /******************************************************************************/
@@ -165,6 +175,24 @@ void TIM4_IRQHandler(void)
 
 
 
+/**
+  * @brief  Zero-cross impulse on PB11 (EXTI11), count it for the synchronized capture.
+  * @param  None
+  * @retval None
+  */
+// From SRAM, the zero-cross time stamp has no flash wait states
+HAL_RAMFUNC void EXTI15_10_IRQHandler(void)
+{
+    if (EXTI->PR & EXTI_PR_PR11)
+    {
+        ZeroCrossDWT = *DWT_CYCCNT;
+        EXTI->PR = EXTI_PR_PR11;
+        ZeroCrossCount++;
+        Trace(TRACE_ZERO_CROSS, ZeroCrossCount);
+    }
+}
+
+
 void USART1_IRQHandler(void)
 {
 		if(USART_GetITStatus(USART1, USART_IT_RXNE) == SET)
@@ -183,6 +211,9 @@ void USART1_IRQHandler(void)
 		{
 				USART_ClearFlag(USART1,USART_FLAG_ORE);
 				USART_ReceiveData(USART1);
+				// The byte is lost, the frame will fail its CRC
+				if (usMBPortUARTOverruns < 0xFFFF)
+						usMBPortUARTOverruns++;
 		}
 }
 
@@ -0,0 +1,98 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include "sysmon.h"
+
+extern float xyData[2048];
+
+volatile uint8_t SysMonIdle;
+volatile uint32_t SysMonMillis;
+
+static volatile uint16_t sysmon_ticks;
+static volatile uint16_t sysmon_idle_ticks;
+static volatile uint16_t sysmon_load;        // 0.1 %, last window
+static volatile uint8_t sysmon_window_done;  // The main loop has a new load
+
+// Paint the stack from its bottom to under the frame of the caller,
+// before the interrupts run
+static void sysmon_paint(void) {
+    uint32_t sp;  // Its address is the current stack pointer
+    uint32_t *top = &sp - SYSMON_STACK_GAP;
+    uint32_t *p;
+
+    if (HAL_STACK_SIZE == 0)
+        return;
+    for (p = HAL_STACK_BOTTOM; p < top; p++)
+        *p = SYSMON_STACK_PAINT;
+}
+
+// Bytes from the top of the stack to the lowest word written
+static uint16_t sysmon_stack_used(void) {
+    const uint32_t *p = HAL_STACK_BOTTOM;
+    const uint32_t *end = HAL_STACK_BOTTOM + HAL_STACK_SIZE / 4;
+
+    while (p < end && *p == SYSMON_STACK_PAINT)
+        p++;
+    return (uint16_t)((end - p) * 4);
+}
+
+void SysMon_Init(void) {
+    uint8_t i;
+
+    for (i = 0; i < SYSTEM_NREGS; i++)
+        usRegSystemBuf[i] = 0;
+    sysmon_paint();
+    usRegSystemBuf[SYSTEM_STACK_SIZE] = HAL_STACK_SIZE;
+    usRegSystemBuf[SYSTEM_STACK_USED] = sysmon_stack_used();
+    usRegSystemBuf[SYSTEM_RAM_SIZE] = HAL_RAM_SIZE;
+    usRegSystemBuf[SYSTEM_DATA_SIZE] = HAL_DATA_SIZE;
+    usRegSystemBuf[SYSTEM_BSS_SIZE] = HAL_BSS_SIZE;
+    usRegSystemBuf[SYSTEM_FFT_BUFFER] = sizeof(xyData);
+    if (HAL_STACK_SIZE != 0)
+        usRegSystemBuf[SYSTEM_RAM_FREE] = HAL_RAM_SIZE - HAL_DATA_SIZE - HAL_BSS_SIZE - HAL_STACK_SIZE;
+    usRegSystemBuf[SYSTEM_FLASH_SIZE] = HAL_FLASH_SIZE;
+    usRegSystemBuf[SYSTEM_FLASH_USED] = HAL_FLASH_USED;
+    usRegSystemBuf[SYSTEM_RAMFUNC_SIZE] = HAL_RAMFUNC_SIZE;
+}
+
+void SysMon_Tick(void) {
+    SysMonMillis++;
+    if (SysMonIdle)
+        sysmon_idle_ticks++;
+    if (++sysmon_ticks >= SYSMON_WINDOW_MS) {
+        sysmon_load = (uint16_t)((uint32_t)(sysmon_ticks - sysmon_idle_ticks) * 1000 / sysmon_ticks);
+        sysmon_ticks = 0;
+        sysmon_idle_ticks = 0;
+        sysmon_window_done = 1;
+    }
+}
+
+void SysMon_Poll(void) {
+    // Only the peak load is reset, the stack is not painted again with the
+    // interrupts running, its high-water mark is since the reset
+    if (usRegSystemBuf[SYSTEM_CONTROL] != 0) {
+        usRegSystemBuf[SYSTEM_CONTROL] = 0;
+        usRegSystemBuf[SYSTEM_CPU_LOAD_MAX] = usRegSystemBuf[SYSTEM_CPU_LOAD];
+    }
+    if (!sysmon_window_done)
+        return;
+    sysmon_window_done = 0;
+    usRegSystemBuf[SYSTEM_CPU_LOAD] = sysmon_load;
+    if (sysmon_load > usRegSystemBuf[SYSTEM_CPU_LOAD_MAX])
+        usRegSystemBuf[SYSTEM_CPU_LOAD_MAX] = sysmon_load;
+    usRegSystemBuf[SYSTEM_STACK_USED] = sysmon_stack_used();
+}
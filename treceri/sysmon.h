@@ -0,0 +1,59 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * System monitor: CPU load, stack high-water mark and the memory map,
+ * published at REG_SYSTEM_START.
+ *
+ * The CPU load is sampled by SysTick: every 1 ms it looks whether the main
+ * loop is idle (SysMonIdle, set while it only polls Modbus or waits for the
+ * zero-cross) and once a second gives the busy time in 0.1 %. The waits for
+ * /DRA, the computation and the Delay() of the relays count as busy.
+ *
+ * SysTick also counts the time since reset (SysMonMillis) for the history.
+ *
+ * The free stack is painted at reset, the lowest word that lost the paint
+ * is the high-water mark. It is scanned once a second, the stack used equal
+ * to the stack size means it overflowed into .bss.
+ */
+
+#ifndef SYSMON_H
+#define SYSMON_H
+
+#include <stdint.h>
+#include "main.h"
+#include "hal.h"
+
+#define SYSMON_WINDOW_MS     1000        // Load averaging time, also the stack scan period
+#define SYSMON_STACK_PAINT   0xA5A5A5A5
+#define SYSMON_STACK_GAP     16          // Words left unpainted under the caller's frame
+
+extern volatile uint8_t SysMonIdle;
+extern volatile uint32_t SysMonMillis;  // Time since reset, ms (wraps after 49 days)
+
+#define SYSMON_IDLE()        (SysMonIdle = 1)
+#define SYSMON_BUSY()        (SysMonIdle = 0)
+
+// Paint the free stack and fill in the memory map, first thing in main()
+// (before Board_Init starts SysTick)
+void SysMon_Init(void);
+// From the SysTick interrupt
+void SysMon_Tick(void);
+// SYSTEM_CONTROL, load and stack registers, from the main loop
+void SysMon_Poll(void);
+
+#endif
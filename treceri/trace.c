@@ -0,0 +1,45 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include "trace.h"
+
+volatile uint16_t TraceMask;
+
+static void trace_clear(void) {
+    uint16_t i;
+
+    TraceMask = 0;
+    for (i = TRACE_HEAD; i < TRACE_NREGS; i++)
+        usRegTraceBuf[i] = 0;
+    usRegTraceBuf[TRACE_NUM_ENTRIES] = TRACE_ENTRIES;
+    usRegTraceBuf[TRACE_CLOCK_MHZ] = 72;
+}
+
+void Trace_Init(void) {
+    usRegTraceBuf[TRACE_CONTROL] = 0;
+    usRegTraceBuf[TRACE_MASK] = TRACE_MASK_DEFAULT;
+    trace_clear();
+    TraceMask = TRACE_MASK_DEFAULT;
+}
+
+void Trace_Poll(void) {
+    if (usRegTraceBuf[TRACE_CONTROL] & TRACE_CLEAR) {
+        usRegTraceBuf[TRACE_CONTROL] &= ~TRACE_CLEAR;
+        trace_clear();
+    }
+    TraceMask = (usRegTraceBuf[TRACE_CONTROL] & TRACE_STOP) ? 0 : usRegTraceBuf[TRACE_MASK];
+}
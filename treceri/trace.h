@@ -0,0 +1,81 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+ * Event trace: a ring of the last TRACE_ENTRIES events of the board, each
+ * with its DWT timestamp (72 cycles = 1 us), readable at REG_TRACE_START.
+ *
+ * Trace() takes about 20 cycles: the entry is written with the interrupts
+ * masked, so an interrupt that traces (zero-cross, Modbus events) cannot take
+ * the same slot. Do not call it inside ENTER_CRITICAL_SECTION, it unmasks them.
+ *
+ * The master writes TRACE_STOP to TRACE_CONTROL, reads the ring from TRACE_HEAD
+ * (the oldest entry) on, then writes 0 to record again. treceri/decode_trace.py
+ * does that and prints the timeline.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "stm32f10x.h"
+#include "main.h"
+#include "hal.h"
+
+// Event ids, the bit of TRACE_MASK
+#define TRACE_MB_EVENT       1   // Modbus event posted, arg 0 ready, 1 frame received, 2 execute, 3 reply sent
+#define TRACE_ZERO_CROSS     2   // Zero-cross edge, arg ZeroCrossCount (off by default, 100 per second)
+#define TRACE_STEP           3   // A step of the measurement cycle starts, arg 0..2
+#define TRACE_CAPTURE_START  4   // After the zero-cross wait, arg capture sequence
+#define TRACE_CAPTURE_END    5   // arg 1 if the capture failed
+#define TRACE_CHANNEL_START  6   // SRAM load, window, FFT and phase of a channel, arg 0..5
+#define TRACE_CHANNEL_END    7   // arg 0..5
+#define TRACE_PUBLISH        8   // Results published, arg capture sequence
+
+#define TRACE_MASK_DEFAULT   (0xFFFE & ~(1 << TRACE_ZERO_CROSS))
+
+// Bits of TRACE_CONTROL
+#define TRACE_STOP           0x0001  // Do not record, to read a consistent ring
+#define TRACE_CLEAR          0x0002  // Empty the ring, reads back 0
+
+// TRACE_MASK, 0 while stopped
+extern volatile uint16_t TraceMask;
+
+static inline void Trace(uint8_t event, uint16_t arg) {
+    uint32_t now;
+    u16 *entry;
+
+    if (!(TraceMask & (1 << event)))
+        return;
+    now = *(volatile uint32_t *)HAL_DWT_CYCCNT;
+    __set_PRIMASK(1);
+    entry = &usRegTraceBuf[TRACE_DATA + 4 * usRegTraceBuf[TRACE_HEAD]];
+    usRegTraceBuf[TRACE_HEAD] = (usRegTraceBuf[TRACE_HEAD] + 1) & (TRACE_ENTRIES - 1);
+    usRegTraceBuf[TRACE_COUNT]++;
+    entry[0] = now >> 16;
+    entry[1] = now & 0xFFFF;
+    entry[2] = event;
+    entry[3] = arg;
+    __set_PRIMASK(0);
+}
+
+// Empty ring, default mask
+void Trace_Init(void);
+// TRACE_CONTROL and TRACE_MASK written by the master, from the main loop
+void Trace_Poll(void);
+
+#endif
@@ -3,6 +3,8 @@ import numpy as np
 import glob
 import time
 import re
+import os
+from capture_file import open_capture, volts, sample_times
 
 # Constants for phase calculation
 EPSILON = 1e-10
@@ -40,8 +42,8 @@ def myfftPhase(fft_data, nn, k):
 
     return angle_deg
 
-# Function to read the sine wave data from a file, plot it, compute FFT, and analyze
-def plot_sine_wave(filename):
+# Function to read the sine wave data from a text file (the old `--text` output)
+def load_text_file(filename):
     # Lists to store time values and real parts
     time = []
     real_part = []
@@ -58,9 +60,10 @@ def plot_sine_wave(filename):
                 time.append(len(time) / 11718.75)  # Assuming 11718.75 samples per second
 
     # Convert lists to numpy arrays for FFT computation
-    real_part = np.array(real_part)
-    time = np.array(time)
-    
+    return np.array(time), np.array(real_part)
+
+# Function to plot a sine wave, compute FFT, and analyze
+def plot_sine_wave(filename, time, real_part):
     # Compute FFT
     n = len(real_part)  # Number of samples
     fft_result = np.fft.fft(real_part)
@@ -120,19 +123,23 @@ def extract_phase(filename):
 
 # Main function to animate the sine wave plots
 if __name__ == '__main__':
-    # Get all the sine wave files that match the pattern
-    files = glob.glob('sine_wave_*.txt')
-    
-    # Sort files based on the numeric phase extracted from the filename
-    files = sorted(files, key=extract_phase)
-
-    # Initialize the plot
-    #plt.figure(figsize=(12, 6))
+    if os.path.exists('sine_waves.cap'):
+        # All the signals in one binary file, mapped in memory
+        header, records = open_capture('sine_waves.cap')
+        t = sample_times(header)
+        for record in records:
+            plot_sine_wave(f"sine_wave_{record['label']:.1f}", t, volts(header, record['data'][:, 0]))
+    else:
+        # Get all the sine wave files that match the pattern
+        files = glob.glob('sine_wave_*.txt')
+        
+        # Sort files based on the numeric phase extracted from the filename
+        files = sorted(files, key=extract_phase)
 
-    # Loop through all the files and plot each one
-    for file in files:
-        plot_sine_wave(file)
-        #time.sleep(1)  # Optional additional delay between file loads
+        # Loop through all the files and plot each one
+        for file in files:
+            plot_sine_wave(file, *load_text_file(file))
+            #time.sleep(1)  # Optional additional delay between file loads
 
     # Keep the final plot on screen after animation ends
     plt.show()
@@ -0,0 +1,305 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Phase and RMS of many recorded waveforms, on all the cores (dsp_batch.c).
+
+    Usage: batch_analyze [--threads N] [--scalar] [--csv FILE] FILE.cap ...
+           batch_analyze --bench [--records N] [--threads N]
+        --threads   worker threads (default: all the cores)
+        --scalar    no SIMD kernel, to compare
+        --csv       write record, sequence, label, channel, phase, rms, magnitude
+        --bench     throughput on N generated 6 channel records (default 2000)
+
+    The capture files are the ones of capture_file.h, 2048 samples per record
+    and any number of interleaved channels. FLOAT32 records (volts) are
+    quantised to ADC codes first, like the MCP3903 would.
+
+    The benchmark gives records/s (6 channels each) and records/s per core for
+    the firmware chain (convert, window, real_fft, myfftPhase), and for the
+    one bin kernel of dsp_batch.c, scalar and SIMD, on 1 and N threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "dsp_core.h"
+#include "dsp_batch.h"
+#include "capture_file.h"
+
+#define SAMPLE_RATE     11718.75  // Hz, the MCP3903 data rate
+#define VOLTS_PER_CODE  (2.39 / 3.0 / 32767.0)
+#define BENCH_CHANNELS  6
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int16_t volts_to_code(double volts) {
+    double code = nearbyint(volts / VOLTS_PER_CODE);
+    return (int16_t)(code > 32767 ? 32767 : (code < -32768 ? -32768 : code));
+}
+
+/* ----------------------- Files --------------------------------------------*/
+typedef struct {
+    int16_t *codes;              // records x DSP_NUM_POINTS x channels
+    capture_record_t *records;
+    uint32_t count;
+    uint16_t channels;
+    float scale;
+} batch_input_t;
+
+static int load_capture(const char *path, batch_input_t *in) {
+    capture_file_t *capture = capture_open(path);
+    size_t values;
+    float *volts = NULL;
+
+    if (capture == NULL)
+        return -1;
+    if (capture->header.samples != DSP_NUM_POINTS) {
+        fprintf(stderr, "%s: %u samples per record, expected %d\n", path, capture->header.samples, DSP_NUM_POINTS);
+        capture_close(capture);
+        return -1;
+    }
+    in->count = capture->header.records;
+    in->channels = capture->header.channels;
+    in->scale = capture->header.sample_format == CAPTURE_INT16 ? capture->header.scale : (float)VOLTS_PER_CODE;
+    values = (size_t)DSP_NUM_POINTS * in->channels;
+    in->codes = malloc(in->count * values * sizeof(int16_t));
+    in->records = malloc(in->count * sizeof(capture_record_t));
+    if (capture->header.sample_format == CAPTURE_FLOAT32)
+        volts = malloc(values * sizeof(float));
+    if (in->codes == NULL || in->records == NULL || (capture->header.sample_format == CAPTURE_FLOAT32 && volts == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        capture_close(capture);
+        return -1;
+    }
+
+    for (uint32_t r = 0; r < in->count; r++) {
+        int16_t *codes = in->codes + r * values;
+        int result = volts ? capture_read(capture, &in->records[r], volts)
+                           : capture_read(capture, &in->records[r], codes);
+        if (result != 1) {
+            fprintf(stderr, "%s: cannot read record %u\n", path, r);
+            capture_close(capture);
+            return -1;
+        }
+        if (volts) {
+            for (size_t i = 0; i < values; i++)
+                codes[i] = volts_to_code(volts[i]);
+        }
+    }
+    free(volts);
+    capture_close(capture);
+    return 0;
+}
+
+static int analyze_file(const char *path, const dsp_batch_plan_t *plan, int threads, FILE *csv) {
+    batch_input_t in;
+    dsp_batch_result_t *results;
+    double t0, seconds;
+
+    if (load_capture(path, &in) != 0)
+        return -1;
+    results = malloc((size_t)in.count * in.channels * sizeof(dsp_batch_result_t));
+    if (results == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    t0 = now_seconds();
+    if (dsp_batch_run(plan, in.codes, (size_t)DSP_NUM_POINTS * in.channels, in.count, in.channels,
+                      in.scale, results, threads) != 0) {
+        fprintf(stderr, "%s: batch failed\n", path);
+        return -1;
+    }
+    seconds = now_seconds() - t0;
+    printf("%s: %u records x %u channel(s) in %.4f s, %.0f records/s\n", path, in.count, in.channels,
+           seconds, seconds > 0 ? in.count / seconds : 0.0);
+
+    if (csv) {
+        for (uint32_t r = 0; r < in.count; r++) {
+            for (uint16_t ch = 0; ch < in.channels; ch++) {
+                const dsp_batch_result_t *res = &results[(size_t)r * in.channels + ch];
+                fprintf(csv, "%s,%u,%u,%.4f,%u,%.4f,%.6f,%.6f\n", path, r, in.records[r].sequence,
+                        in.records[r].label, ch, res->phase, res->rms, res->magnitude);
+            }
+        }
+    }
+    free(results);
+    free(in.records);
+    free(in.codes);
+    return 0;
+}
+
+/* ----------------------- Benchmark ----------------------------------------*/
+// 6 channels of 50 Hz at 0.1 V RMS, 60 degrees apart, a little noise
+static void make_records(int16_t *codes, size_t count) {
+    uint32_t noise = 1;
+
+    for (size_t r = 0; r < count; r++) {
+        for (int n = 0; n < DSP_NUM_POINTS; n++) {
+            for (int ch = 0; ch < BENCH_CHANNELS; ch++) {
+                double p = (r * 7.0 + ch * 60.0) * DEG2RAD;
+                noise = noise * 1664525u + 1013904223u;
+                codes[(r * DSP_NUM_POINTS + n) * BENCH_CHANNELS + ch] =
+                    volts_to_code(0.1 * sqrt(2.0) * sin(2.0 * PI * 50.0 * n / SAMPLE_RATE + p) +
+                                  0.001 * ((noise >> 8) / 8388608.0 - 1.0));
+            }
+        }
+    }
+}
+
+// The firmware chain, one thread
+static double bench_fft_chain(const int16_t *codes, size_t count, dsp_batch_result_t *results) {
+    static int16_t channel[DSP_NUM_POINTS];
+    static float data[2 * DSP_NUM_POINTS];
+    double t0 = now_seconds();
+
+    for (size_t r = 0; r < count; r++) {
+        for (int ch = 0; ch < BENCH_CHANNELS; ch++) {
+            for (int n = 0; n < DSP_NUM_POINTS; n++)
+                channel[n] = codes[(r * DSP_NUM_POINTS + n) * BENCH_CHANNELS + ch];
+            convert_adc_codes(channel, data, DSP_NUM_POINTS);
+            apply_flattop_window(data, flattop_window, DSP_NUM_POINTS);
+            real_fft(data, DSP_NUM_POINTS);
+            results[r * BENCH_CHANNELS + ch].phase = myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN);
+        }
+    }
+    return now_seconds() - t0;
+}
+
+static double bench_batch(const dsp_batch_plan_t *plan, const int16_t *codes, size_t count,
+                          dsp_batch_result_t *results, int threads) {
+    double t0 = now_seconds();
+
+    dsp_batch_run(plan, codes, (size_t)DSP_NUM_POINTS * BENCH_CHANNELS, count, BENCH_CHANNELS,
+                  (float)VOLTS_PER_CODE, results, threads);
+    return now_seconds() - t0;
+}
+
+static void print_rate(const char *name, const char *kernel, int threads, size_t count, double seconds) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    double rate = count / seconds;
+
+    if (cores > threads || cores < 1)
+        cores = threads;
+    printf("%-12s %-8s %7d %12.0f %14.0f\n", name, kernel, threads, rate, rate / cores);
+}
+
+static int run_bench(size_t count, int threads) {
+    int16_t *codes = malloc(count * DSP_NUM_POINTS * BENCH_CHANNELS * sizeof(int16_t));
+    dsp_batch_result_t *reference = malloc(count * BENCH_CHANNELS * sizeof(dsp_batch_result_t));
+    dsp_batch_result_t *results = malloc(count * BENCH_CHANNELS * sizeof(dsp_batch_result_t));
+    dsp_batch_plan_t scalar, simd;
+    double max_error = 0;
+
+    if (codes == NULL || reference == NULL || results == NULL ||
+        dsp_batch_plan_init(&scalar, DSP_FUNDAMENTAL_BIN, 1) != 0 ||
+        dsp_batch_plan_init(&simd, DSP_FUNDAMENTAL_BIN, 0) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    make_records(codes, count);
+
+    printf("%zu records of %d channels x %d samples\n", count, BENCH_CHANNELS, DSP_NUM_POINTS);
+    printf("%-12s %-8s %7s %12s %14s\n", "chain", "kernel", "threads", "records/s", "records/s/core");
+    print_rate("fft", "scalar", 1, count, bench_fft_chain(codes, count, reference));
+    print_rate("one_bin", scalar.kernel, 1, count, bench_batch(&scalar, codes, count, results, 1));
+    print_rate("one_bin", simd.kernel, 1, count, bench_batch(&simd, codes, count, results, 1));
+    if (threads > 1)
+        print_rate("one_bin", simd.kernel, threads, count, bench_batch(&simd, codes, count, results, threads));
+
+    // The one bin kernel must give the phase of the FFT chain
+    for (size_t i = 0; i < count * BENCH_CHANNELS; i++) {
+        double e = fabs(fmod(results[i].phase - reference[i].phase + 540.0, 360.0) - 180.0);
+        if (e > max_error) max_error = e;
+    }
+    printf("max phase difference from the fft chain: %.5f degrees\n", max_error);
+
+    dsp_batch_plan_free(&simd);
+    dsp_batch_plan_free(&scalar);
+    free(results);
+    free(reference);
+    free(codes);
+    return max_error < 0.01 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int force_scalar = 0, bench = 0, first_file = 0;
+    size_t bench_records = 2000;
+    const char *csv_path = NULL;
+    FILE *csv = NULL;
+    dsp_batch_plan_t plan;
+    int result = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--scalar")) {
+            force_scalar = 1;
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (!strcmp(argv[i], "--bench")) {
+            bench = 1;
+        } else if (!strcmp(argv[i], "--records") && i + 1 < argc) {
+            bench_records = strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-') {
+            first_file = i;
+            break;
+        } else {
+            bench = 0;
+            break;  // Unknown option, the usage below
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+    if (bench)
+        return run_bench(bench_records ? bench_records : 1, threads);
+    if (first_file == 0) {
+        fprintf(stderr, "Usage: %s [--threads N] [--scalar] [--csv FILE] FILE.cap ...\n"
+                        "       %s --bench [--records N] [--threads N]\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    if (dsp_batch_plan_init(&plan, DSP_FUNDAMENTAL_BIN, force_scalar) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    printf("kernel %s, %d thread(s)\n", plan.kernel, threads);
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            perror(csv_path);
+            return 1;
+        }
+        fprintf(csv, "file,record,sequence,label,channel,phase,rms,magnitude\n");
+    }
+    for (int i = first_file; i < argc; i++) {
+        if (analyze_file(argv[i], &plan, threads, csv) != 0)
+            result = 1;
+    }
+    if (csv)
+        fclose(csv);
+    dsp_batch_plan_free(&plan);
+    return result;
+}
@@ -0,0 +1,143 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "capture_file.h"
+
+static size_t sample_size(const capture_header_t *header) {
+    return header->sample_format == CAPTURE_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+capture_file_t *capture_create(const char *path, float sample_rate, uint16_t channels,
+                               uint16_t sample_format, uint32_t samples, float scale) {
+    capture_file_t *capture;
+
+    if (sample_format != CAPTURE_INT16 && sample_format != CAPTURE_FLOAT32) {
+        fprintf(stderr, "Unknown capture sample format %u\n", sample_format);
+        return NULL;
+    }
+    capture = calloc(1, sizeof(capture_file_t));
+    if (capture == NULL)
+        return NULL;
+    capture->file = fopen(path, "wb");
+    if (capture->file == NULL) {
+        perror(path);
+        free(capture);
+        return NULL;
+    }
+
+    capture->writing = 1;
+    memcpy(capture->header.magic, CAPTURE_MAGIC, 4);
+    capture->header.version = CAPTURE_VERSION;
+    capture->header.header_size = sizeof(capture_header_t);
+    capture->header.sample_rate = sample_rate;
+    capture->header.channels = channels;
+    capture->header.sample_format = sample_format;
+    capture->header.samples = samples;
+    capture->header.scale = (sample_format == CAPTURE_INT16) ? scale : 1.0f;
+
+    // Written again with the record count when the file is closed
+    if (fwrite(&capture->header, sizeof(capture_header_t), 1, capture->file) != 1) {
+        perror(path);
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+int capture_write(capture_file_t *capture, float label, uint32_t sequence, const void *data) {
+    capture_record_t record = { label, sequence };
+    size_t count = (size_t)capture->header.samples * capture->header.channels;
+
+    if (fwrite(&record, sizeof(record), 1, capture->file) != 1 ||
+        fwrite(data, sample_size(&capture->header), count, capture->file) != count) {
+        perror("capture_write");
+        return -1;
+    }
+    capture->header.records++;
+    return 0;
+}
+
+int capture_write_signal(capture_file_t *capture, float label, uint32_t sequence, const float *signal) {
+    float *real;
+    int result;
+
+    if (capture->header.channels != 1 || capture->header.sample_format != CAPTURE_FLOAT32) {
+        fprintf(stderr, "capture_write_signal needs one float32 channel\n");
+        return -1;
+    }
+    real = malloc(capture->header.samples * sizeof(float));
+    if (real == NULL)
+        return -1;
+    for (uint32_t i = 0; i < capture->header.samples; i++)
+        real[i] = signal[2 * i];
+    result = capture_write(capture, label, sequence, real);
+    free(real);
+    return result;
+}
+
+int capture_close(capture_file_t *capture) {
+    int result = 0;
+
+    if (capture->writing && (fseek(capture->file, 0, SEEK_SET) != 0 ||
+        fwrite(&capture->header, sizeof(capture_header_t), 1, capture->file) != 1)) {
+        perror("capture_close");
+        result = -1;
+    }
+    if (fclose(capture->file) != 0)
+        result = -1;
+    free(capture);
+    return result;
+}
+
+capture_file_t *capture_open(const char *path) {
+    capture_file_t *capture = calloc(1, sizeof(capture_file_t));
+
+    if (capture == NULL)
+        return NULL;
+    capture->file = fopen(path, "rb");
+    if (capture->file == NULL) {
+        perror(path);
+        free(capture);
+        return NULL;
+    }
+    if (fread(&capture->header, sizeof(capture_header_t), 1, capture->file) != 1 ||
+        memcmp(capture->header.magic, CAPTURE_MAGIC, 4) != 0 ||
+        capture->header.version != CAPTURE_VERSION ||
+        (capture->header.sample_format != CAPTURE_INT16 && capture->header.sample_format != CAPTURE_FLOAT32) ||
+        fseek(capture->file, capture->header.header_size, SEEK_SET) != 0) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(capture->file);
+        free(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+int capture_read(capture_file_t *capture, capture_record_t *record, void *data) {
+    size_t count = (size_t)capture->header.samples * capture->header.channels;
+
+    if (fread(record, sizeof(capture_record_t), 1, capture->file) != 1)
+        return feof(capture->file) ? 0 : -1;
+    if (fread(data, sample_size(&capture->header), count, capture->file) != count) {
+        fprintf(stderr, "capture_read: short record\n");
+        return -1;
+    }
+    return 1;
+}
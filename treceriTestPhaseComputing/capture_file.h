@@ -0,0 +1,87 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Binary capture file: many records of the same size in one file, read in
+    Python with numpy.memmap (capture_file.py).
+
+        capture_header_t                  32 bytes
+        record 0: capture_record_t        8 bytes
+                  samples x channels      int16 or float32, channels interleaved
+        record 1: ...
+
+    All fields are little endian (the byte order of the PC and of the STM32).
+*/
+
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define CAPTURE_MAGIC    "TRCP"
+#define CAPTURE_VERSION  1
+
+// Sample formats
+#define CAPTURE_INT16    1  // ADC codes, volts = code * scale
+#define CAPTURE_FLOAT32  2  // Volts
+
+typedef struct {
+    char     magic[4];       // CAPTURE_MAGIC
+    uint16_t version;        // CAPTURE_VERSION
+    uint16_t header_size;    // The first record starts here
+    float    sample_rate;    // Hz
+    uint16_t channels;
+    uint16_t sample_format;  // CAPTURE_INT16 or CAPTURE_FLOAT32
+    uint32_t samples;        // Samples of each channel in one record
+    uint32_t records;        // Written by capture_close()
+    float    scale;          // Volts per code for CAPTURE_INT16, else 1
+    uint32_t reserved;
+} capture_header_t;
+
+typedef struct {
+    float    label;          // Phase in degrees of a generated signal, or 0
+    uint32_t sequence;       // Record number, or capture sequence number
+} capture_record_t;
+
+typedef struct {
+    FILE *file;
+    capture_header_t header;
+    int writing;             // Made by capture_create()
+} capture_file_t;
+
+// Create the file, returns NULL on error
+capture_file_t *capture_create(const char *path, float sample_rate, uint16_t channels,
+                               uint16_t sample_format, uint32_t samples, float scale);
+
+// Append one record, `data` has samples x channels values. Returns 0 or -1.
+int capture_write(capture_file_t *capture, float label, uint32_t sequence, const void *data);
+
+// Append one channel of a Re, Im, Re, Im, ... signal as float32 (the Im side is not kept)
+int capture_write_signal(capture_file_t *capture, float label, uint32_t sequence, const float *signal);
+
+// Write the record count (for a created file) and close. Returns 0 or -1.
+int capture_close(capture_file_t *capture);
+
+// Open a file for reading and check its header, returns NULL on error
+capture_file_t *capture_open(const char *path);
+
+// Read the next record, `data` has room for samples x channels values.
+// Returns 1, 0 at the end of the file, or -1.
+int capture_read(capture_file_t *capture, capture_record_t *record, void *data);
+
+#endif
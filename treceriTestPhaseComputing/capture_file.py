@@ -0,0 +1,53 @@
+# Reader of the binary capture files written by capture_file.c (sine_waves.cap).
+#
+# The records are mapped with numpy.memmap, nothing is parsed or copied until
+# a record is used, so even a long sweep opens instantly:
+#
+#   header, records = open_capture('sine_waves.cap')
+#   records['label'][i]      phase of record i (degrees)
+#   records['data'][i]       samples of record i, shape (samples, channels)
+#   volts(header, records['data'][i])
+
+import numpy as np
+
+MAGIC = b'TRCP'
+INT16 = 1
+FLOAT32 = 2
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S4'),
+    ('version', '<u2'),
+    ('header_size', '<u2'),
+    ('sample_rate', '<f4'),
+    ('channels', '<u2'),
+    ('sample_format', '<u2'),
+    ('samples', '<u4'),
+    ('records', '<u4'),
+    ('scale', '<f4'),
+    ('reserved', '<u4'),
+])
+
+def open_capture(filename):
+    header = np.fromfile(filename, dtype=HEADER_DTYPE, count=1)[0]
+    if header['magic'] != MAGIC:
+        raise ValueError(f'{filename} is not a capture file')
+
+    sample = '<i2' if header['sample_format'] == INT16 else '<f4'
+    record_dtype = np.dtype([
+        ('label', '<f4'),
+        ('sequence', '<u4'),
+        ('data', sample, (int(header['samples']), int(header['channels']))),
+    ])
+    records = np.memmap(filename, dtype=record_dtype, mode='r',
+                        offset=int(header['header_size']), shape=(int(header['records']),))
+    return header, records
+
+# Samples of one record in volts
+def volts(header, data):
+    if header['sample_format'] == INT16:
+        return data.astype(np.float32) * header['scale']
+    return data
+
+# Time of each sample in seconds
+def sample_times(header):
+    return np.arange(int(header['samples'])) / float(header['sample_rate'])
@@ -0,0 +1,279 @@
+/*************************************************************************************
+    Copyright (C) 2024 Nedelcu Bogdan Sebastian
+    This code is free software: you can redistribute it and/or modify it
+    under the following conditions:
+    1. The use, distribution, and modification of this file are permitted for any
+       purpose, provided that the following conditions are met:
+    2. Any redistribution or modification of this file must retain the original
+       copyright notice, this list of conditions, and the following attribution:
+       "Original work by Nedelcu Bogdan Sebastian."
+    3. The original author provides no warranty regarding the functionality or fitness
+       of this software for any particular purpose. Use it at your own risk.
+    By using this software, you agree to retain the name of the original author in any
+    derivative works or distributions.
+    ------------------------------------------------------------------------
+    This code is provided as-is, without any express or implied warranties.
+**************************************************************************************/
+
+/*
+    Monte-Carlo sweep of the phase accuracy of the DSP core, on all the cores of the PC.
+
+    Usage: phase_sweep [--threads N] [--trials N] [--phase-step DEG] [--seed S] [--csv FILE]
+        --threads      worker threads (default: all the cores)
+        --trials       noise draws for every phase (default 4)
+        --phase-step   phase step in degrees, 0 to 360 (default 5)
+        --seed         base seed of the noise (default 1)
+        --csv          also write the table to FILE
+
+    A condition is one combination of amplitude x noise x mains frequency x
+    DC offset x harmonics. For every condition we run all the phases and trials
+    through the firmware chain: ADC codes, Flat Top window, FFT, phase of bin 9.
+    The error is the distance from the phase of the generated signal at t = 0.
+
+    The result is one line per condition: mean, RMS and maximum error in degrees.
+    Each condition has its own RNG, seeded from --seed and the condition index,
+    so the numbers are the same for any number of threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "dsp_core.h"
+
+#define SAMPLE_RATE 11718.75  // Hz, the MCP3903 data rate
+
+// 2.678 mA (the firmware threshold) to 100 mA on the 5.6 ohm resistor, volts RMS
+static const double amplitudes[] = { 0.015, 0.025, 0.1, 0.3, 0.56 };
+// Uniform noise, peak volts
+static const double noises[] = { 0.0, 0.0005, 0.002, 0.005 };
+static const double frequencies[] = { 49.5, 49.75, 50.0, 50.25, 50.5 };
+static const double dc_offsets[] = { 0.0, 0.005, 0.02 };
+
+typedef struct {
+    const char *name;
+    double h3;  // 3rd harmonic, relative to the fundamental
+    double h5;  // 5th harmonic
+} harmonics_t;
+
+static const harmonics_t harmonics[] = {
+    { "none",     0.0,  0.0  },
+    { "h3_5%",    0.05, 0.0  },
+    { "h3_10%h5", 0.10, 0.05 },
+};
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+#define NUM_CONDITIONS (COUNT(amplitudes) * COUNT(noises) * COUNT(frequencies) * COUNT(dc_offsets) * COUNT(harmonics))
+
+typedef struct {
+    double amplitude;
+    double noise;
+    double frequency;
+    double dc_offset;
+    const harmonics_t *harmonics;
+    long scenarios;
+    double mean_error;  // Signed, degrees
+    double rms_error;
+    double max_error;   // Absolute
+} condition_t;
+
+static condition_t conditions[NUM_CONDITIONS];
+static int trials = 4;
+static double phase_step = 5.0;
+static uint64_t seed = 1;
+
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t next_condition = 0;
+
+/* ----------------------- RNG ----------------------------------------------*/
+// splitmix64, to make a good xorshift state from a small seed
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// xorshift64*, uniform in [-1, 1)
+static double rng_uniform(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / 4503599627370496.0 - 1.0;
+}
+
+/* ----------------------- Sweep --------------------------------------------*/
+// Signed phase error in degrees, -180..180
+static double phase_error(double computed, double expected) {
+    double d = fmod(computed - expected, 360.0);
+    if (d > 180.0) d -= 360.0;
+    if (d < -180.0) d += 360.0;
+    return d;
+}
+
+static void run_condition(condition_t *c, size_t index, float *data, int16_t *codes) {
+    uint64_t state = splitmix64(seed * 0x100000001B3ULL + index);
+    double peak = c->amplitude * sqrt(2.0);
+    double w = 2.0 * PI * c->frequency / SAMPLE_RATE;
+    double sum = 0, sum_sq = 0, max = 0;
+    long n = 0;
+
+    for (double phase = 0.0; phase < 360.0; phase += phase_step) {
+        double p = phase * DEG2RAD;
+        for (int t = 0; t < trials; t++) {
+            // The signal as the MCP3903 gives it, then the firmware chain
+            for (int i = 0; i < DSP_NUM_POINTS; i++) {
+                double v = c->dc_offset + peak * (sin(w * i + p)
+                         + c->harmonics->h3 * sin(3.0 * (w * i + p))
+                         + c->harmonics->h5 * sin(5.0 * (w * i + p)))
+                         + c->noise * rng_uniform(&state);
+                double code = nearbyint(v / 2.39 * 3.0 * 32767.0);
+                codes[i] = (int16_t)(code > 32767 ? 32767 : (code < -32768 ? -32768 : code));
+            }
+            convert_adc_codes(codes, data, DSP_NUM_POINTS);
+            apply_flattop_window(data, flattop_window, DSP_NUM_POINTS);
+            real_fft(data, DSP_NUM_POINTS);
+
+            double e = phase_error(myfftPhase(data, DSP_NUM_POINTS, DSP_FUNDAMENTAL_BIN), phase);
+            sum += e;
+            sum_sq += e * e;
+            if (fabs(e) > max) max = fabs(e);
+            n++;
+        }
+    }
+    c->scenarios = n;
+    c->mean_error = sum / n;
+    c->rms_error = sqrt(sum_sq / n);
+    c->max_error = max;
+}
+
+static void *worker(void *arg) {
+    float *data = malloc(2 * DSP_NUM_POINTS * sizeof(float));
+    int16_t *codes = malloc(DSP_NUM_POINTS * sizeof(int16_t));
+    size_t index;
+
+    (void)arg;
+    if (data == NULL || codes == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (;;) {
+        pthread_mutex_lock(&next_lock);
+        index = next_condition++;
+        pthread_mutex_unlock(&next_lock);
+        if (index >= NUM_CONDITIONS)
+            break;
+        run_condition(&conditions[index], index, data, codes);
+    }
+    free(codes);
+    free(data);
+    return NULL;
+}
+
+static void make_conditions(void) {
+    size_t i = 0;
+
+    for (size_t a = 0; a < COUNT(amplitudes); a++)
+        for (size_t n = 0; n < COUNT(noises); n++)
+            for (size_t f = 0; f < COUNT(frequencies); f++)
+                for (size_t d = 0; d < COUNT(dc_offsets); d++)
+                    for (size_t h = 0; h < COUNT(harmonics); h++) {
+                        conditions[i].amplitude = amplitudes[a];
+                        conditions[i].noise = noises[n];
+                        conditions[i].frequency = frequencies[f];
+                        conditions[i].dc_offset = dc_offsets[d];
+                        conditions[i].harmonics = &harmonics[h];
+                        i++;
+                    }
+}
+
+static void write_table(FILE *out, const char *format) {
+    fprintf(out, format, "amplitude", "noise", "freq", "dc", "harmonics", "n", "mean_err", "rms_err", "max_err");
+    for (size_t i = 0; i < NUM_CONDITIONS; i++) {
+        const condition_t *c = &conditions[i];
+        if (out == stdout)
+            fprintf(out, "%9.3f %7.4f %6.2f %6.3f %-9s %6ld %9.4f %9.4f %9.4f\n", c->amplitude, c->noise,
+                    c->frequency, c->dc_offset, c->harmonics->name, c->scenarios, c->mean_error,
+                    c->rms_error, c->max_error);
+        else
+            fprintf(out, "%.3f,%.4f,%.2f,%.3f,%s,%ld,%.6f,%.6f,%.6f\n", c->amplitude, c->noise,
+                    c->frequency, c->dc_offset, c->harmonics->name, c->scenarios, c->mean_error,
+                    c->rms_error, c->max_error);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *csv_path = NULL;
+    pthread_t *ids;
+    struct timespec t0, t1;
+    double seconds;
+    long total = 0;
+    const condition_t *worst = &conditions[0];
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--trials") && i + 1 < argc) {
+            trials = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--phase-step") && i + 1 < argc) {
+            phase_step = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--threads N] [--trials N] [--phase-step DEG] [--seed S] [--csv FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (trials < 1) trials = 1;
+    if (phase_step <= 0.0 || phase_step > 360.0) phase_step = 5.0;
+
+    make_conditions();
+
+    ids = malloc(threads * sizeof(pthread_t));
+    if (ids == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < threads; i++) {
+        if (pthread_create(&ids[i], NULL, worker, NULL) != 0) {
+            fprintf(stderr, "Cannot start thread %ld\n", i);
+            return 1;
+        }
+    }
+    for (long i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(ids);
+    seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    write_table(stdout, "%9s %7s %6s %6s %-9s %6s %9s %9s %9s\n");
+    for (size_t i = 0; i < NUM_CONDITIONS; i++) {
+        total += conditions[i].scenarios;
+        if (conditions[i].max_error > worst->max_error)
+            worst = &conditions[i];
+    }
+    printf("\n%ld scenarios in %.2f s on %ld thread(s), %.0f scenarios/s\n", total, seconds, threads, total / seconds);
+    printf("Worst: %.3f V, noise %.4f, %.2f Hz, dc %.3f, %s: max error %.4f degrees\n", worst->amplitude,
+           worst->noise, worst->frequency, worst->dc_offset, worst->harmonics->name, worst->max_error);
+
+    if (csv_path) {
+        FILE *csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            perror(csv_path);
+            return 1;
+        }
+        write_table(csv, "%s,%s,%s,%s,%s,%s,%s,%s,%s\n");
+        fclose(csv);
+    }
+    return 0;
+}
@@ -1,8 +1,10 @@
 import matplotlib.pyplot as plt
 import numpy as np
+import os
+from capture_file import open_capture, volts, sample_times
 
-# Function to read the sine wave data from a file, plot it, compute FFT, and analyze
-def plot_sine_wave(filename):
+# Function to read the sine wave data from a text file (the old `--text` output)
+def load_text_file(filename):
     # Lists to store time values and real parts
     time = []
     real_part = []
@@ -19,9 +21,16 @@ def plot_sine_wave(filename):
                 time.append(len(time) / 11718.75)  # Assuming 11718.75 samples per second
 
     # Convert lists to numpy arrays for FFT computation
-    real_part = np.array(real_part)
-    time = np.array(time)
-    
+    return np.array(time), np.array(real_part)
+
+# Load the record of one phase from the capture file
+def load_capture_record(filename, phase):
+    header, records = open_capture(filename)
+    index = int(np.argmin(np.abs(records['label'] - phase)))
+    return sample_times(header), volts(header, records['data'][index, :, 0])
+
+# Function to plot a sine wave, compute FFT, and analyze
+def plot_sine_wave(time, real_part):
     # Plotting the real part of the sine wave
     plt.figure(figsize=(12, 6))
     plt.subplot(2, 1, 1)  # Create a 2x1 subplot
@@ -71,4 +80,7 @@ def plot_sine_wave(filename):
 
 # Example usage
 if __name__ == '__main__':
-    plot_sine_wave('sine_wave_344.0.txt')
+    if os.path.exists('sine_waves.cap'):
+        plot_sine_wave(*load_capture_record('sine_waves.cap', 344.0))
+    else:
+        plot_sine_wave(*load_text_file('sine_wave_344.0.txt'))
@@ -18,8 +18,9 @@
 /*
     In this example we have the following:
         - we generate signals from 0 degrees to 359 degrees,
-          of speciffic phase, with noise, and write the values to files named `sine_wave_x.x.txt`
-          with 1.0 degree step
+          of speciffic phase, with noise, and write all of them to one binary file
+          `sine_waves.cap` (see capture_file.h), with 1.0 degree step.
+          With `--text` each signal is also written to a file named `sine_wave_x.x.txt`
         - we generate the Flattop window and write to a file `flattop_window.txt`
         - we apply the window to the signal real side
         - we compute FFT
@@ -71,11 +72,9 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
-
-#define PI        3.1415926535897932384626433832795
-#define DEG2RAD   0.01745329251994329576923690768489
-#define RAD2DEG   57.295779513082320876798154814105  // 180/PI
-#define EPSILON   1e-8 // Small value for zero comparison
+#include <string.h>
+#include "dsp_core.h"
+#include "capture_file.h"
 
 #define NUM_POINTS 2048  // Number of points in the buffer
 #define VALUES_PER_LINE 8  // Number of values to print per line
@@ -87,41 +86,14 @@ const float sample_rate = 11718.75;  // Sample rate in Hz (calculated to get ind
 const float noise_aplitude = 0.002;  // Noise level   
 float signal_phase = 0.0;            // Signal phase
 
-// Flattop Window: If the purpose of the test focus more on the energy value of a
-// certain periodic signal frequency point. For example for Upeak, Upeak-peak, Urms,
-// then the accuracy of its amplitude is more important, and a window with slighty
-// wider lobes is better.
-// The Flat Top window has a flatter passband, which helps retain accurate amplitude
-// and phase information, particularly when analyzing signals where frequency peaks
-// must be well-isolated. Since the window decreases the leakage, the phase extraction
-// becomes more accurate. However, keep in mind that this window broadens the peaks,
-// so you might sacrifice some resolution in the frequency domain.
-void generate_flat_top_window(float *flattop_window, size_t num_points) {
-    // Flat Top window coefficients
-    const float a0 = 1.0;
-    const float a1 = 1.93;
-    const float a2 = 1.29;
-    const float a3 = 0.388;
-    const float a4 = 0.028;
-
-    for (size_t n = 0; n < num_points; n++) {
-        // Compute the normalized index value
-        float factor = (2 * PI * n) / (num_points - 1);
-
-        // Apply the Flat Top window function
-        flattop_window[n] = a0
-                          - a1 * cos(factor)
-                          + a2 * cos(2 * factor)
-                          - a3 * cos(3 * factor)
-                          + a4 * cos(4 * factor);
-    }
-    
+// Write the Flat Top window coefficients to `flattop_window.txt`, as a C array
+// (the window itself is computed by generate_flat_top_window() in dspcore)
+void write_flat_top_window(const float *flattop_window) {
     // Open a file to write the values
     FILE *file = fopen("flattop_window.txt", "w");
     if (file == NULL) {
         fprintf(stderr, "Failed to open file for writing\n");
-        free(flattop_window);
-        //return 1;
+        return;
     }
 
     // Write window coefficients to file in the desired format
@@ -227,131 +199,8 @@ Counterclockwise Measurement: The angle is measured counterclockwise from the po
 }
 */
 
-// Calculates the FFT phase at a given frequency index.
-// Input: data is complex FFT Re[V(0)],Im[V(0)], Re[V(1)],Im[V(1)],...
-// Input: nn is the number of points in the data and in the FFT,
-//           nn must be a power of 2
-// Input: k is frequency index 0 to nn/2-1
-//        E.g., if nn=16384, then k can be 0 to 8191
-// Output: Phase at this frequency
-// data is an array of 2*nn elements
-// returns 0 if k >= nn/2
-float myfftPhase (float data[], unsigned long nn, int k) {
-    if (k >= nn / 2) {
-        return 0.0; // out of range
-    }
-
-    // Extract the real and imaginary parts of the k-th element
-    float real_part = data[2 * k];
-    float imag_part = data[2 * k + 1];
-
-    // Handle the case when both real and imaginary parts are zero (undefined phase)
-    if (fabs(real_part) < EPSILON && fabs(imag_part) < EPSILON) {
-        return 0.0; // phase is undefined
-    }
-
-    // Calculate the angle in radians using atan2
-    float angle_rad = atan2(imag_part, real_part);
-
-    // Convert the angle to degrees
-    float angle_deg = angle_rad * RAD2DEG;
-
-    angle_deg += 137.1126;
-    
-    if (angle_deg < 0.0) {
-        angle_deg += 360.0;
-    }
-    
-    return angle_deg;
-}
-
-// Helper macro to swap two float values
-#define SWAP(a, b) { float temp = (a); (a) = (b); (b) = temp; }
-
-// FFT optimized for a signal array only with real side values, no imaginary
-// Input: nn is the number of points in the data and in the FFT (must be a power of 2).
-// Input: data is an array of nn real elements (no imaginary part initially, from ADC)
-//        Re(0),0,Re(1),0,Re(2),...Re(nn-1),0
-// Output: data will be transformed to contain complex FFT coefficients where the real
-//         and imaginary parts are interleaved in the same array (Re, Im, Re, Im...).
-void real_fft (float data[], unsigned long nn) {
-    unsigned long n, mmax, m, j, istep, i;
-    double wtemp, wr, wpr, wpi, wi, theta;
-    double tempr, tempi;
-
-    // `nn` is the number of real samples. In the complex FFT,
-    // `n` will be twice `nn` because each complex number has two parts (Re and Im).
-    n = nn << 1;  // n = 2 * nn, for real + imaginary storage (even though input is real, output will be complex)
-
-    // ---- Bit-reversal Reordering ----
-    // The FFT requires the input to be in bit-reversed order to optimize
-    // in-place computation. Here we rearrange the data in such order.
-    j = 1;
-    for (i = 1; i < n; i += 2) {
-        if (j > i) {  // Swap only if j > i to avoid swapping elements back
-            SWAP(data[j-1], data[i-1]);  // Swap the real part
-            SWAP(data[j], data[i]);      // Swap the imaginary part (initially 0)
-        }
-
-        // Bit-reversal logic (this shifts the bits around in a specific way
-        // to reorder the data).
-        m = n >> 1;
-        while (m >= 2 && j > m) {
-            j -= m;
-            m >>= 1;
-        }
-        j += m;
-    }
-
-    // ---- Danielson-Lanczos Recursion ----
-    // This is the heart of the FFT algorithm, where the computation is performed
-    // in a recursive, divide-and-conquer manner.
-    mmax = 2;  // mmax starts at 2 (which means we first handle 2-element blocks)
-    while (n > mmax) {
-        istep = mmax << 1;  // Step size for each FFT recursion level (block size)
-
-        // Calculate the angle (theta) for the trigonometric recurrence relation
-        // that is used to compute the FFT (twiddle factors).
-        theta = -2.0 * PI / mmax;
-        wtemp = sin(0.5 * theta);
-        wpr = -2.0 * wtemp * wtemp;  // Real part of twiddle factor
-        wpi = sin(theta);            // Imaginary part of twiddle factor
-        wr = 1.0;                    // Starting value for twiddle real part (cos(0) = 1)
-        wi = 0.0;                    // Starting value for twiddle imaginary part (sin(0) = 0)
-
-        // For each recursion level, we loop through the data in chunks
-        // of size `mmax`, computing the FFT step for each pair of elements.
-        for (m = 1; m < mmax; m += 2) {
-            for (i = m; i <= n; i += istep) {
-                // The FFT is performed in pairs of elements. We compute the
-                // real and imaginary parts of these elements and apply the twiddle factors.
-                j = i + mmax;  // This is the other element in the pair
-
-                // Calculate the real and imaginary components of the twiddle factor for this step
-                tempr = wr * data[j-1] - wi * data[j];
-                tempi = wr * data[j] + wi * data[j-1];
-
-                // Update the real and imaginary parts with the calculated values
-                data[j-1] = data[i-1] - tempr;
-                data[j]   = data[i]   - tempi;
-                data[i-1] = data[i-1] + tempr;
-                data[i]   = data[i]   + tempi;
-            }
-
-            // Update the twiddle factors for the next iteration. This is done
-            // using the recurrence relation for trigonometric functions.
-            wtemp = wr;
-            wr = wr * wpr - wi * wpi + wr;
-            wi = wi * wpr + wtemp * wpi + wi;
-        }
-
-        // Double the block size for the next level of recursion.
-        mmax = istep;
-    }
-}
-
-// Generate a sine wave buffer with phase in degrees and write to a file
-void generate_sine_wave(float *signal, size_t num_points, float rms_amplitude, float frequency, float sample_rate, float phase_degrees, float noise_amplitude, const char* filename) {
+// Generate a sine wave buffer with phase in degrees
+void generate_sine_wave(float *signal, size_t num_points, float rms_amplitude, float frequency, float sample_rate, float phase_degrees, float noise_amplitude) {
     // Convert phase from degrees to radians
     float phase_radians = phase_degrees * (PI / 180.0);
 
@@ -376,8 +225,10 @@ void generate_sine_wave(float *signal, size_t num_points, float rms_amplitude, f
         
         k += 1;
     }
-   
-    // Write the generated buffer to a file
+}
+
+// Write the generated buffer to a text file, the old format of the Python scripts
+void write_sine_wave_text(const float *signal, size_t num_points, const char *filename) {
     FILE *file = fopen(filename, "w");
     if (file == NULL) {
         perror("Error opening file");
@@ -392,13 +243,6 @@ void generate_sine_wave(float *signal, size_t num_points, float rms_amplitude, f
     fclose(file);
 }
 
-// Apply the Flat Top window to the signal
-void apply_flattop_window(float *signal, const float *flattop_window, int num_points) {
-    for (size_t n = 0; n < num_points; n++) {
-        signal[n * 2] = signal[n * 2] * flattop_window[n]; // Apply the window to the real part
-    }
-}
-
 // Hanning Window (Von Hann): If the test signal has multiple frequency components, 
 // the spectrum is very complex, and the purpose of the test is more focused on 
 // the frequency rather the energy.
@@ -408,23 +252,36 @@ void generate_hanning_window(float *window, size_t num_points) {
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     float *flattop_window = (float *)malloc(NUM_POINTS * sizeof(float)); // Allocate memory for the window
     float *signal = (float *)malloc(2 * NUM_POINTS * sizeof(float)); // Allocate memory for the signal
+    int write_text = (argc > 1 && strcmp(argv[1], "--text") == 0);
+    uint32_t sequence = 0;
+
+    // All the signals in one file, for capture_file.py
+    capture_file_t *capture = capture_create("sine_waves.cap", sample_rate, 1, CAPTURE_FLOAT32, NUM_POINTS, 1.0);
+    if (capture == NULL) {
+        return 1;
+    }
 
     //test_atan2();
     //printf("\n");
 
     // Generate Flattop Window coefficients and write to file
     generate_flat_top_window(flattop_window, NUM_POINTS);
+    write_flat_top_window(flattop_window);
     
     while (signal_phase < 359.0) {
-        // Create a file name that includes the signal phase
-        char filename[30];  // Adjust the size as needed
-        sprintf(filename, "sine_wave_%.1f.txt", signal_phase);
-    
-        // Generate the sine wave with phase and noise and write to file
-        generate_sine_wave(signal, num_points, rms_amplitude, frequency, sample_rate, signal_phase, noise_aplitude, filename);
+        // Generate the sine wave with phase and noise
+        generate_sine_wave(signal, num_points, rms_amplitude, frequency, sample_rate, signal_phase, noise_aplitude);
+        capture_write_signal(capture, signal_phase, sequence++, signal);
+
+        if (write_text) {
+            // Create a file name that includes the signal phase
+            char filename[30];  // Adjust the size as needed
+            sprintf(filename, "sine_wave_%.1f.txt", signal_phase);
+            write_sine_wave_text(signal, num_points, filename);
+        }
     
         // Apply the Flattop window to the signal
         apply_flattop_window(signal, flattop_window, num_points);
@@ -438,6 +295,8 @@ int main() {
         signal_phase += 1.0; 
     }
 
+    capture_close(capture);
+
     // Free allocated memory
     free(signal);
     free(flattop_window);